@@ -7,76 +7,230 @@
   Released under Apache 2.0; refer to LICENSE.txt
 */
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "aldr.h"
+#include "arena.h"
+#include "parallel.h"
 #include "uniform.h"
 
-struct aldr_recycle_s preprocess_aldr_recycle(u32* a, u32 n) {
-    // assume k <= 31
-    u32 m = 0;
-    for (u32 i = 0; i < n; ++i) {
-        m += a[i];
+// Leaves of the DDG tree: outcome i has a leaf at level j when bit
+// num_levels - 1 - j of c * a[i] is set. Rather than scanning all
+// outcomes once per level, count the leaves at each bit position, then
+// place them in one more pass. Each thread takes a contiguous range of
+// outcomes, so the leaves at each level stay in increasing order of i
+// and the table does not depend on the number of threads.
+struct leaves_build_s {
+    const u32 *a32;
+    const u64 *a64;
+    u64 c;
+    void *Q;
+    u32 n;
+    u32 num_levels;
+    u32 leaves_width;
+    u32 Q_width;
+    u64 *sums;
+    u32 *counts;
+    void *leaves_flat;
+};
+
+static inline u64 leaves_weight(const struct leaves_build_s *b, u64 i) {
+    return b->c * (b->a64 ? b->a64[i] : b->a32[i]);
+}
+
+static void leaves_sum(void *p, u32 t, u32 num_threads) {
+    struct leaves_build_s *b = p;
+    u64 begin, end;
+    parallel_range(b->n, t, num_threads, &begin, &end);
+    u64 sum = 0;
+    u64 max_weight = 0;
+    for (u64 i = begin; i < end; ++i) {
+        sum += b->a32[i];
+        max_weight = max(max_weight, (u64)b->a32[i]);
     }
-    u32 k = 32 - __builtin_clz(m) - (0 == (m & (m-1)));
-    u32 K = k << 1;
-    u64 c = (1ull << K) / m;
-    u32 r = (1ull << K) % m;
-    u64 *Q = calloc(n, sizeof(u64));
+    b->sums[2 * t] = sum;
+    b->sums[2 * t + 1] = max_weight;
+}
 
-    u32 num_leaves = 0;
-    for (u32 i = 0; i < n; ++i) {
-        num_leaves += __builtin_popcountll(Q[i] = c * a[i]);
+static u64 leaves_total(struct leaves_build_s *b, u32 num_threads, u64 *max_weight) {
+    // Return the sum of the weights, and their maximum in max_weight.
+    b->sums = calloc(2 * num_threads, sizeof(u64));
+    parallel_run(num_threads, leaves_sum, b);
+    u64 m = 0;
+    u64 max_a = 0;
+    for (u32 t = 0; t < num_threads; ++t) {
+        m += b->sums[2 * t];
+        max_a = max(max_a, b->sums[2 * t + 1]);
     }
+    free(b->sums);
+    *max_weight = max_a;
+    return m;
+}
 
-    u32 num_levels = K + 1;
-    u32 *breadths = calloc(num_levels, sizeof(u32));
-    u32 *leaves_flat = calloc(num_leaves, sizeof(u32));
+static void leaves_count(void *p, u32 t, u32 num_threads) {
+    struct leaves_build_s *b = p;
+    u64 begin, end;
+    parallel_range(b->n, t, num_threads, &begin, &end);
+    u32 *counts = b->counts + 64 * t;
+    for (u64 i = begin; i < end; ++i) {
+        for (u64 w = leaves_weight(b, i); w; w &= w - 1) {
+            ++counts[__builtin_ctzll(w)];
+        }
+    }
+}
 
-    u32 location = 0;
-    for (u32 j = 0; j <= K; ++j) {
-        u64 bit = (1ull << (K - j));
-        for (u32 i = 0; i < n; ++i) {
-            if (Q[i] & bit) {
-                leaves_flat[location] = i;
-                ++breadths[j];
-                ++location;
+static void leaves_place(void *p, u32 t, u32 num_threads) {
+    // counts holds the next location of this thread at each bit position.
+    struct leaves_build_s *b = p;
+    u64 begin, end;
+    parallel_range(b->n, t, num_threads, &begin, &end);
+    u32 *location = b->counts + 64 * t;
+    SWITCH_INDEX_WIDTH(width, b->leaves_width,
+        for (u64 i = begin; i < end; ++i) {
+            u64 w = leaves_weight(b, i);
+            if (b->Q) {
+                index_set(b->Q, b->Q_width, i, w);
             }
+            for (; w; w &= w - 1) {
+                index_set(b->leaves_flat, width, location[__builtin_ctzll(w)]++, i);
+            }
+        }
+    )
+}
+
+static u32 count_leaves(struct leaves_build_s *b, u32 num_threads, u32 *breadths) {
+    // Add to breadths, zero on entry, and return the number of leaves.
+    b->counts = calloc(64 * num_threads, sizeof(u32));
+    parallel_run(num_threads, leaves_count, b);
+    u32 location = 0;
+    for (u32 j = 0; j < b->num_levels; ++j) {
+        u32 bit = b->num_levels - 1 - j;
+        for (u32 t = 0; t < num_threads; ++t) {
+            u32 count = b->counts[64 * t + bit];
+            b->counts[64 * t + bit] = location;
+            location += count;
+            breadths[j] += count;
         }
     }
+    return location;
+}
+
+static void place_leaves(struct leaves_build_s *b, u32 num_threads) {
+    // Fill b->leaves_flat, and b->Q when set.
+    parallel_run(num_threads, leaves_place, b);
+    free(b->counts);
+}
+
+// One block holds the breadths, leaves_flat and weights of a table, and
+// its acceleration table if any.
+static void ddg_block_sizes(u32 num_levels, u32 num_leaves, u32 leaf_size, u32 n, u64 weight_size,
+        u32 accel_bits, bool accel, u64 *bytes) {
+    bytes[0] = (u64)num_levels * sizeof(u32);
+    bytes[1] = (u64)num_leaves * leaf_size;
+    bytes[2] = (u64)n * weight_size;
+    bytes[3] = accel ? sizeof(u64) << accel_bits : 0;
+}
+
+static void *ddg_block_new(u32 num_levels, u32 num_leaves, u32 leaf_size, u32 n, u64 weight_size,
+        u32 accel_bits, u64 **accel, void **arrays) {
+    u64 bytes[4];
+    ddg_block_sizes(num_levels, num_leaves, leaf_size, n, weight_size, accel_bits, accel != NULL, bytes);
+    void *block = table_block_new(4, bytes, arrays);
+    if (accel) {
+        *accel = arrays[3];
+    }
+    return block;
+}
+
+static u64 ddg_block_bytes(u32 num_levels, u32 num_leaves, u32 leaf_size, u32 n, u64 weight_size,
+        u32 accel_bits, bool accel) {
+    u64 bytes[4];
+    ddg_block_sizes(num_levels, num_leaves, leaf_size, n, weight_size, accel_bits, accel, bytes);
+    return table_block_bytes(4, bytes);
+}
+
+struct aldr_recycle_s preprocess_aldr_recycle(u32* a, u32 n) {
+    return preprocess_aldr_recycle_parallel(a, n, 1);
+}
+
+// When accel is not NULL, the block also holds an acceleration table of
+// *accel_bits bits, lowered to the depth of the tree.
+static struct aldr_recycle_s build_aldr_recycle(u32* a, u32 n, u32 num_threads,
+        u32 *accel_bits, u64 **accel) {
+    // assume k <= 31
+    num_threads = parallel_threads(num_threads, n);
+    struct leaves_build_s b = { .a32 = a, .n = n };
+    u64 max_weight;
+    u32 m = leaves_total(&b, num_threads, &max_weight);
+    u32 k = 32 - __builtin_clz(m) - (0 == (m & (m-1)));
+    // Amplify as far as the recycled state allows, as in
+    // preprocess_aldr64_recycle.
+    u32 K = max(k, min(k << 1, (u32)RR_MAX_RANGE_BITS));
+    u64 c = (1ull << K) / m;
+    u32 r = (1ull << K) % m;
+
+    u32 num_levels = K + 1;
+    b.c = c;
+    b.num_levels = num_levels;
+    b.leaves_width = index_width(n - 1);
+    b.Q_width = c * max_weight <= UINT32_MAX ? sizeof(u32) : sizeof(u64);
+    u32 breadths[64] = { 0 };
+    u32 num_leaves = count_leaves(&b, num_threads, breadths);
+    if (accel) {
+        *accel_bits = min(*accel_bits, K);
+    }
+    void *arrays[4];
+    void *block = ddg_block_new(num_levels, num_leaves, b.leaves_width, n, b.Q_width,
+        accel ? *accel_bits : 0, accel, arrays);
+    memcpy(arrays[0], breadths, num_levels * sizeof(u32));
+    b.leaves_flat = arrays[1];
+    b.Q = arrays[2];
+    place_leaves(&b, num_threads);
 
     return (struct aldr_recycle_s){
             .length_breadths = num_levels,
             .length_leaves_flat = num_leaves,
             .length_weights = n,
             .reject_weight = r,
-            .breadths = breadths,
-            .leaves_flat = leaves_flat,
-            .weights = Q
+            .leaves_width = b.leaves_width,
+            .weights_width = b.Q_width,
+            .breadths = arrays[0],
+            .leaves_flat = b.leaves_flat,
+            .weights = b.Q,
+            .block = block
         };
 }
 
-u32 sample_aldr_recycle(struct aldr_recycle_s* f) {
+struct aldr_recycle_s preprocess_aldr_recycle_parallel(u32* a, u32 n, u32 num_threads) {
+    return build_aldr_recycle(a, n, num_threads, NULL, NULL);
+}
+
+static inline u32 sample_aldr_recycle_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct aldr_recycle_s* f, u32 leaves_width, u32 weights_width) {
     u32 num_flips = f->length_breadths - 1;
     while (1) {
-        u64 flips = flip_n_from_unif(num_flips);
+        u64 flips = flip_n_from_unif_local(s, state, bound, num_flips);
         if (unlikely(flips >= (1ull << num_flips) - f->reject_weight)) {
-            merge_state(flips - (1ull << num_flips) + f->reject_weight, f->reject_weight);
+            rr_lost(s, lost_aldr, 1ull << num_flips, f->reject_weight);
+            rr_count(s, aldr_rejections, 1);
+            merge_state_local(state, bound, flips - (1ull << num_flips) + f->reject_weight, f->reject_weight);
             continue;
         }
+        rr_lost(s, lost_aldr, 1ull << num_flips, (1ull << num_flips) - f->reject_weight);
         u32 depth = 0;
         u32 location = 0;
         u32 val = 0;
         u32 pos = num_flips;
         for (;;) {
             if (val < f->breadths[depth]) {
-                u32 ans = f->leaves_flat[location + val];
+                u32 ans = index_get(f->leaves_flat, leaves_width, location + val);
                 u64 mask = (1ull<<pos) - 1;
                 u64 recycle_state = mask & flips;
-                u64 recycle_bound = f->weights[ans];
+                u64 recycle_bound = index_get(f->weights, weights_width, ans);
                 recycle_state += recycle_bound & mask;
-                merge_state(recycle_state, recycle_bound);
+                merge_state_local(state, bound, recycle_state, recycle_bound);
                 return ans;
             }
             location += f->breadths[depth];
@@ -87,83 +241,110 @@ u32 sample_aldr_recycle(struct aldr_recycle_s* f) {
     }
 }
 
-u32 bytes_aldr_recycle(struct aldr_recycle_s *x) {
-    return
-        sizeof(x->length_breadths)
-            + sizeof(x->length_leaves_flat)
-            + sizeof(x->length_weights)
-            + x->length_breadths * sizeof(x->breadths[0])
-            + x->length_leaves_flat * sizeof(x->leaves_flat[0])
-            + x->length_weights * sizeof(x->weights[0]);
+u32 sample_aldr_recycle_r(struct rr_state *s, struct aldr_recycle_s* f) {
+    return sample_aldr_recycle_local(s, &s->unif_state, &s->unif_bound, f,
+        f->leaves_width, f->weights_width);
+}
+
+u32 sample_aldr_recycle(struct aldr_recycle_s* f) {
+    return sample_aldr_recycle_r(&rr_default, f);
+}
+
+void sample_aldr_recycle_n_r(struct rr_state *s, struct aldr_recycle_s *f, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_aldr_recycle_r.
+    const struct aldr_recycle_s t = *f;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    SWITCH_INDEX_WIDTH(leaves_width, t.leaves_width,
+        SWITCH_WEIGHT_WIDTH(weights_width, t.weights_width,
+            for (u64 i = 0; i < count; ++i) {
+                out[i] = sample_aldr_recycle_local(s, &state, &bound, &t, leaves_width, weights_width);
+            }
+        )
+    )
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_aldr_recycle_n(struct aldr_recycle_s *f, u32 *out, u64 count) {
+    sample_aldr_recycle_n_r(&rr_default, f, out, count);
+}
+
+u64 bytes_aldr_recycle(struct aldr_recycle_s *x) {
+    return sizeof(*x) + ddg_block_bytes(x->length_breadths, x->length_leaves_flat, x->leaves_width,
+        x->length_weights, x->weights_width, 0, 0);
 }
 
 void free_aldr_recycle (struct aldr_recycle_s x) {
-    free(x.breadths);
-    free(x.leaves_flat);
-    free(x.weights);
+    table_block_free(x.block);
 }
 
 
 struct fldr_eo_s preprocess_fldr_eo(u32* a, u32 n) {
+    return preprocess_fldr_eo_parallel(a, n, 1);
+}
+
+static struct fldr_eo_s build_fldr_eo(u32* a, u32 n, u32 num_threads,
+        u32 *accel_bits, u64 **accel) {
     // assume k <= 31
-    u32 m = 0;
-    for (u32 i = 0; i < n; ++i) {
-        m += a[i];
-    }
+    num_threads = parallel_threads(num_threads, n);
+    struct leaves_build_s b = { .a32 = a, .n = n, .c = 1 };
+    u64 max_weight;
+    u32 m = leaves_total(&b, num_threads, &max_weight);
     u32 k = 32 - __builtin_clz(m) - (0 == (m & (m-1)));
 
-    u32 num_leaves = 0;
-    for (u32 i = 0; i < n; ++i) {
-        num_leaves += __builtin_popcount(a[i]);
-    }
-
     u32 num_levels = k + 1;
-    u32 *breadths = calloc(num_levels, sizeof(u32));
-    u32 *leaves_flat = calloc(num_leaves, sizeof(u32));
-
-    u32 location = 0;
-    for(u32 j = 0; j <= k; ++j) {
-        u32 bit = (1u << (k - j));
-        for (u32 i = 0; i < n; ++i) {
-            if (a[i] & bit) {
-                leaves_flat[location] = i;
-                ++location;
-                ++breadths[j];
-            }
-        }
+    b.num_levels = num_levels;
+    b.leaves_width = index_width(n - 1);
+    u32 breadths[64] = { 0 };
+    u32 num_leaves = count_leaves(&b, num_threads, breadths);
+    if (accel) {
+        *accel_bits = min(*accel_bits, k);
     }
-
-    u32 *weights = malloc(n * sizeof(u32));
-    memcpy(weights, a, n * sizeof(u32));
+    void *arrays[4];
+    void *block = ddg_block_new(num_levels, num_leaves, b.leaves_width, n, sizeof(u32),
+        accel ? *accel_bits : 0, accel, arrays);
+    memcpy(arrays[0], breadths, num_levels * sizeof(u32));
+    b.leaves_flat = arrays[1];
+    place_leaves(&b, num_threads);
+    memcpy(arrays[2], a, n * sizeof(u32));
 
     return (struct fldr_eo_s){
             .length_breadths = num_levels,
             .length_leaves_flat = num_leaves,
             .length_weights = n,
+            .leaves_width = b.leaves_width,
             .uniform_preprocessed = uniform_preprocess(m),
-            .breadths = breadths,
-            .leaves_flat = leaves_flat,
-            .weights = weights
+            .breadths = arrays[0],
+            .leaves_flat = b.leaves_flat,
+            .weights = arrays[2],
+            .block = block
         };
 }
 
-u32 sample_fldr_eo(struct fldr_eo_s* f) {
+struct fldr_eo_s preprocess_fldr_eo_parallel(u32* a, u32 n, u32 num_threads) {
+    return build_fldr_eo(a, n, num_threads, NULL, NULL);
+}
+
+static inline u32 sample_fldr_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct fldr_eo_s* f, u32 leaves_width) {
     u32 num_flips = f->length_breadths - 1;
     u32 depth = 0;
     u32 location = 0;
     u32 val = 0;
-    u32 flips = uniform_prediv(&(f->uniform_preprocessed));
+    u32 flips = uniform_prediv_local(s, state, bound, &(f->uniform_preprocessed));
     u32 pos = num_flips;
     for (;;) {
         if (val < f->breadths[depth]) {
-            u32 ans = f->leaves_flat[location + val];
+            u32 ans = index_get(f->leaves_flat, leaves_width, location + val);
             u32 mask = (1u<<pos) - 1;
             u32 recycle_state = mask & flips;
             u32 recycle_bound = f->weights[ans];
             recycle_state += recycle_bound & mask;
             // equivalent and maybe faster:
             // recycle_state |= recycle_bound & -(1u<<(pos+1));
-            merge_state(recycle_state, recycle_bound);
+            merge_state_local(state, bound, recycle_state, recycle_bound);
             return ans;
         }
         location += f->breadths[depth];
@@ -173,19 +354,448 @@ u32 sample_fldr_eo(struct fldr_eo_s* f) {
     }
 }
 
-u32 bytes_fldr_eo(struct fldr_eo_s *x) {
-    return
-        sizeof(x->length_breadths)
-            + sizeof(x->length_leaves_flat)
-            + sizeof(x->length_weights)
-            + sizeof(x->uniform_preprocessed)
-            + x->length_breadths * sizeof(x->breadths[0])
-            + x->length_leaves_flat * sizeof(x->leaves_flat[0])
-            + x->length_weights * sizeof(x->weights[0]);
+u32 sample_fldr_eo_r(struct rr_state *s, struct fldr_eo_s* f) {
+    return sample_fldr_eo_local(s, &s->unif_state, &s->unif_bound, f, f->leaves_width);
+}
+
+u32 sample_fldr_eo(struct fldr_eo_s* f) {
+    return sample_fldr_eo_r(&rr_default, f);
+}
+
+void sample_fldr_eo_n_r(struct rr_state *s, struct fldr_eo_s *f, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_fldr_eo_r.
+    const struct fldr_eo_s t = *f;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    SWITCH_INDEX_WIDTH(leaves_width, t.leaves_width,
+        for (u64 i = 0; i < count; ++i) {
+            out[i] = sample_fldr_eo_local(s, &state, &bound, &t, leaves_width);
+        }
+    )
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_fldr_eo_n(struct fldr_eo_s *f, u32 *out, u64 count) {
+    sample_fldr_eo_n_r(&rr_default, f, out, count);
+}
+
+u64 bytes_fldr_eo(struct fldr_eo_s *x) {
+    return sizeof(*x) + ddg_block_bytes(x->length_breadths, x->length_leaves_flat, x->leaves_width,
+        x->length_weights, sizeof(x->weights[0]), 0, 0);
 }
 
 void free_fldr_eo(struct fldr_eo_s x) {
-    free(x.breadths);
-    free(x.leaves_flat);
-    free(x.weights);
+    table_block_free(x.block);
+}
+
+// Acceleration tables: entry p is the walk on the top accel_bits flips p,
+// as (index << 32) | depth. A walk that reaches a leaf at depth <=
+// accel_bits stores the leaf's position in leaves_flat; one that does not
+// stores val at depth accel_bits, with ACCEL_RESUME set in depth.
+#define ACCEL_RESUME (1u << 31)
+
+static void fill_accel(const u32 *breadths, u32 accel_bits, u64 *accel, u32 *accel_location) {
+    u32 location_bits = 0;
+    for (u32 d = 0; d < accel_bits; ++d) {
+        location_bits += breadths[d];
+    }
+    *accel_location = location_bits;
+    for (u64 p = 0; p < (1ull << accel_bits); ++p) {
+        u32 location = 0;
+        u32 val = 0;
+        u32 depth = 0;
+        for (;;) {
+            if (val < breadths[depth]) {
+                accel[p] = ((u64)(location + val) << 32) | depth;
+                break;
+            }
+            if (depth == accel_bits) {
+                accel[p] = ((u64)val << 32) | ACCEL_RESUME | depth;
+                break;
+            }
+            location += breadths[depth];
+            val = ((val - breadths[depth]) << 1) | ((p >> (accel_bits - 1 - depth)) & 1);
+            ++depth;
+        }
+    }
+}
+
+// Position in leaves_flat of the leaf for flips, from the entry e of
+// the acceleration table, and the number pos of flips below it.
+static inline u32 accel_leaf_local(const u32 *breadths, u64 e, u64 flips,
+        u32 num_flips, u32 accel_bits, u32 accel_location, u32 *pos) {
+    u32 depth = e;
+    u32 index = e >> 32;
+    if (likely(!(depth & ACCEL_RESUME))) {
+        *pos = num_flips - depth;
+        return index;
+    }
+    // Continue the walk below the table, one bit at a time.
+    depth = accel_bits;
+    u32 location = accel_location;
+    u32 val = index;
+    u32 p = num_flips - depth;
+    while (val >= breadths[depth]) {
+        location += breadths[depth];
+        --p;
+        val = ((val - breadths[depth]) << 1) | ((flips >> p) & 1);
+        ++depth;
+    }
+    *pos = p;
+    return location + val;
+}
+
+struct aldr_recycle_accel_s preprocess_aldr_recycle_accel(u32* a, u32 n, u32 accel_bits) {
+    assert(accel_bits <= ACCEL_MAX_BITS);
+    struct aldr_recycle_accel_s x = { .accel_bits = accel_bits };
+    x.ddg = build_aldr_recycle(a, n, 1, &x.accel_bits, &x.accel);
+    fill_accel(x.ddg.breadths, x.accel_bits, x.accel, &x.accel_location);
+    return x;
+}
+
+static inline u32 sample_aldr_recycle_accel_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct aldr_recycle_accel_s* x, u32 leaves_width, u32 weights_width) {
+    const struct aldr_recycle_s *f = &x->ddg;
+    u32 num_flips = f->length_breadths - 1;
+    while (1) {
+        u64 flips = flip_n_from_unif_local(s, state, bound, num_flips);
+        if (unlikely(flips >= (1ull << num_flips) - f->reject_weight)) {
+            rr_lost(s, lost_aldr, 1ull << num_flips, f->reject_weight);
+            rr_count(s, aldr_rejections, 1);
+            merge_state_local(state, bound, flips - (1ull << num_flips) + f->reject_weight, f->reject_weight);
+            continue;
+        }
+        rr_lost(s, lost_aldr, 1ull << num_flips, (1ull << num_flips) - f->reject_weight);
+        u64 e = x->accel[flips >> (num_flips - x->accel_bits)];
+        u32 pos;
+        u32 ans = index_get(f->leaves_flat, leaves_width, accel_leaf_local(f->breadths, e, flips,
+            num_flips, x->accel_bits, x->accel_location, &pos));
+        u64 mask = (1ull<<pos) - 1;
+        u64 recycle_state = mask & flips;
+        u64 recycle_bound = index_get(f->weights, weights_width, ans);
+        recycle_state += recycle_bound & mask;
+        merge_state_local(state, bound, recycle_state, recycle_bound);
+        return ans;
+    }
+}
+
+u32 sample_aldr_recycle_accel_r(struct rr_state *s, struct aldr_recycle_accel_s* x) {
+    return sample_aldr_recycle_accel_local(s, &s->unif_state, &s->unif_bound, x,
+        x->ddg.leaves_width, x->ddg.weights_width);
+}
+
+u32 sample_aldr_recycle_accel(struct aldr_recycle_accel_s* x) {
+    return sample_aldr_recycle_accel_r(&rr_default, x);
+}
+
+void sample_aldr_recycle_accel_n_r(struct rr_state *s, struct aldr_recycle_accel_s *x, u32 *out, u64 count) {
+    const struct aldr_recycle_accel_s t = *x;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    SWITCH_INDEX_WIDTH(leaves_width, t.ddg.leaves_width,
+        SWITCH_WEIGHT_WIDTH(weights_width, t.ddg.weights_width,
+            for (u64 i = 0; i < count; ++i) {
+                out[i] = sample_aldr_recycle_accel_local(s, &state, &bound, &t,
+                    leaves_width, weights_width);
+            }
+        )
+    )
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_aldr_recycle_accel_n(struct aldr_recycle_accel_s *x, u32 *out, u64 count) {
+    sample_aldr_recycle_accel_n_r(&rr_default, x, out, count);
+}
+
+u64 bytes_aldr_recycle_accel(struct aldr_recycle_accel_s *x) {
+    const struct aldr_recycle_s *f = &x->ddg;
+    return sizeof(*x) + ddg_block_bytes(f->length_breadths, f->length_leaves_flat, f->leaves_width,
+        f->length_weights, f->weights_width, x->accel_bits, 1);
+}
+
+void free_aldr_recycle_accel(struct aldr_recycle_accel_s x) {
+    free_aldr_recycle(x.ddg);
+}
+
+struct fldr_eo_accel_s preprocess_fldr_eo_accel(u32* a, u32 n, u32 accel_bits) {
+    assert(accel_bits <= ACCEL_MAX_BITS);
+    struct fldr_eo_accel_s x = { .accel_bits = accel_bits };
+    x.ddg = build_fldr_eo(a, n, 1, &x.accel_bits, &x.accel);
+    fill_accel(x.ddg.breadths, x.accel_bits, x.accel, &x.accel_location);
+    return x;
+}
+
+static inline u32 sample_fldr_eo_accel_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct fldr_eo_accel_s* x, u32 leaves_width) {
+    const struct fldr_eo_s *f = &x->ddg;
+    u32 num_flips = f->length_breadths - 1;
+    u32 flips = uniform_prediv_local(s, state, bound, &(f->uniform_preprocessed));
+    u64 e = x->accel[flips >> (num_flips - x->accel_bits)];
+    u32 pos;
+    u32 ans = index_get(f->leaves_flat, leaves_width, accel_leaf_local(f->breadths, e, flips,
+        num_flips, x->accel_bits, x->accel_location, &pos));
+    u32 mask = (1u<<pos) - 1;
+    u32 recycle_state = mask & flips;
+    u32 recycle_bound = f->weights[ans];
+    recycle_state += recycle_bound & mask;
+    merge_state_local(state, bound, recycle_state, recycle_bound);
+    return ans;
+}
+
+u32 sample_fldr_eo_accel_r(struct rr_state *s, struct fldr_eo_accel_s* x) {
+    return sample_fldr_eo_accel_local(s, &s->unif_state, &s->unif_bound, x, x->ddg.leaves_width);
+}
+
+u32 sample_fldr_eo_accel(struct fldr_eo_accel_s* x) {
+    return sample_fldr_eo_accel_r(&rr_default, x);
+}
+
+void sample_fldr_eo_accel_n_r(struct rr_state *s, struct fldr_eo_accel_s *x, u32 *out, u64 count) {
+    const struct fldr_eo_accel_s t = *x;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    SWITCH_INDEX_WIDTH(leaves_width, t.ddg.leaves_width,
+        for (u64 i = 0; i < count; ++i) {
+            out[i] = sample_fldr_eo_accel_local(s, &state, &bound, &t, leaves_width);
+        }
+    )
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_fldr_eo_accel_n(struct fldr_eo_accel_s *x, u32 *out, u64 count) {
+    sample_fldr_eo_accel_n_r(&rr_default, x, out, count);
+}
+
+u64 bytes_fldr_eo_accel(struct fldr_eo_accel_s *x) {
+    const struct fldr_eo_s *f = &x->ddg;
+    return sizeof(*x) + ddg_block_bytes(f->length_breadths, f->length_leaves_flat, f->leaves_width,
+        f->length_weights, sizeof(f->weights[0]), x->accel_bits, 1);
+}
+
+void free_fldr_eo_accel(struct fldr_eo_accel_s x) {
+    free_fldr_eo(x.ddg);
+}
+
+
+static u64 sum_weights64(u64* a, u32 n) {
+    u128 m = 0;
+    for (u32 i = 0; i < n; ++i) {
+        m += a[i];
+    }
+    assert(0 < m && m <= RR_MAX_RANGE);
+    return m;
+}
+
+struct aldr64_recycle_s preprocess_aldr64_recycle(u64* a, u32 n) {
+    u64 m = sum_weights64(a, n);
+    u32 k = 64 - __builtin_clzll(m) - (0 == (m & (m-1)));
+    // Amplify as far as the recycled state allows, so that
+    // flip_n_from_unif never sees more than RR_MAX_RANGE_BITS bits.
+    u32 K = max(k, min(k << 1, (u32)RR_MAX_RANGE_BITS));
+    u64 c = (1ull << K) / m;
+    u64 r = (1ull << K) % m;
+
+    u32 num_levels = K + 1;
+    struct leaves_build_s b = {
+        .a64 = a,
+        .c = c,
+        .n = n,
+        .num_levels = num_levels,
+        .leaves_width = sizeof(u32),
+        .Q_width = sizeof(u64)
+    };
+    u32 breadths[64] = { 0 };
+    u32 num_leaves = count_leaves(&b, 1, breadths);
+    void *arrays[4];
+    void *block = ddg_block_new(num_levels, num_leaves, sizeof(u32), n, sizeof(u64), 0, NULL, arrays);
+    memcpy(arrays[0], breadths, num_levels * sizeof(u32));
+    b.leaves_flat = arrays[1];
+    b.Q = arrays[2];
+    place_leaves(&b, 1);
+
+    return (struct aldr64_recycle_s){
+            .length_breadths = num_levels,
+            .length_leaves_flat = num_leaves,
+            .length_weights = n,
+            .reject_weight = r,
+            .breadths = arrays[0],
+            .leaves_flat = b.leaves_flat,
+            .weights = b.Q,
+            .block = block
+        };
+}
+
+static inline u32 sample_aldr64_recycle_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct aldr64_recycle_s* f) {
+    u32 num_flips = f->length_breadths - 1;
+    while (1) {
+        u64 flips = flip_n_from_unif_local(s, state, bound, num_flips);
+        if (unlikely(flips >= (1ull << num_flips) - f->reject_weight)) {
+            rr_lost(s, lost_aldr, 1ull << num_flips, f->reject_weight);
+            rr_count(s, aldr_rejections, 1);
+            merge_state_local(state, bound, flips - (1ull << num_flips) + f->reject_weight, f->reject_weight);
+            continue;
+        }
+        rr_lost(s, lost_aldr, 1ull << num_flips, (1ull << num_flips) - f->reject_weight);
+        u32 depth = 0;
+        u32 location = 0;
+        u64 val = 0;
+        u32 pos = num_flips;
+        for (;;) {
+            if (val < f->breadths[depth]) {
+                u32 ans = f->leaves_flat[location + val];
+                u64 mask = (1ull<<pos) - 1;
+                u64 recycle_state = mask & flips;
+                u64 recycle_bound = f->weights[ans];
+                recycle_state += recycle_bound & mask;
+                merge_state_local(state, bound, recycle_state, recycle_bound);
+                return ans;
+            }
+            location += f->breadths[depth];
+            --pos;
+            val = ((val - f->breadths[depth]) << 1) | ((flips >> pos) & 1);
+            ++depth;
+        }
+    }
+}
+
+u32 sample_aldr64_recycle_r(struct rr_state *s, struct aldr64_recycle_s* f) {
+    return sample_aldr64_recycle_local(s, &s->unif_state, &s->unif_bound, f);
+}
+
+u32 sample_aldr64_recycle(struct aldr64_recycle_s* f) {
+    return sample_aldr64_recycle_r(&rr_default, f);
+}
+
+void sample_aldr64_recycle_n_r(struct rr_state *s, struct aldr64_recycle_s *f, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_aldr64_recycle_r.
+    const struct aldr64_recycle_s t = *f;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    for (u64 i = 0; i < count; ++i) {
+        out[i] = sample_aldr64_recycle_local(s, &state, &bound, &t);
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_aldr64_recycle_n(struct aldr64_recycle_s *f, u32 *out, u64 count) {
+    sample_aldr64_recycle_n_r(&rr_default, f, out, count);
+}
+
+u64 bytes_aldr64_recycle(struct aldr64_recycle_s *x) {
+    return sizeof(*x) + ddg_block_bytes(x->length_breadths, x->length_leaves_flat, sizeof(u32),
+        x->length_weights, sizeof(x->weights[0]), 0, 0);
+}
+
+void free_aldr64_recycle(struct aldr64_recycle_s x) {
+    table_block_free(x.block);
+}
+
+
+struct fldr64_eo_s preprocess_fldr64_eo(u64* a, u32 n) {
+    u64 m = sum_weights64(a, n);
+    u32 k = 64 - __builtin_clzll(m) - (0 == (m & (m-1)));
+
+    u32 num_levels = k + 1;
+    struct leaves_build_s b = {
+        .a64 = a,
+        .c = 1,
+        .n = n,
+        .num_levels = num_levels,
+        .leaves_width = sizeof(u32)
+    };
+    u32 breadths[64] = { 0 };
+    u32 num_leaves = count_leaves(&b, 1, breadths);
+    void *arrays[4];
+    void *block = ddg_block_new(num_levels, num_leaves, sizeof(u32), n, sizeof(u64), 0, NULL, arrays);
+    memcpy(arrays[0], breadths, num_levels * sizeof(u32));
+    b.leaves_flat = arrays[1];
+    place_leaves(&b, 1);
+    memcpy(arrays[2], a, n * sizeof(u64));
+
+    // The precomputed division only covers 1 < m < 2^32.
+    struct uniform_preprocessed_s uniform_preprocessed = { 0 };
+    if (1 < m && m < (1ull << 32)) {
+        uniform_preprocessed = uniform_preprocess(m);
+    }
+
+    return (struct fldr64_eo_s){
+            .length_breadths = num_levels,
+            .length_leaves_flat = num_leaves,
+            .length_weights = n,
+            .num_outcomes = m,
+            .uniform_preprocessed = uniform_preprocessed,
+            .modulus = uniform_modulus(m),
+            .breadths = arrays[0],
+            .leaves_flat = b.leaves_flat,
+            .weights = arrays[2],
+            .block = block
+        };
+}
+
+static inline u32 sample_fldr64_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct fldr64_eo_s* f) {
+    u32 num_flips = f->length_breadths - 1;
+    u32 depth = 0;
+    u32 location = 0;
+    u64 val = 0;
+    u64 flips = likely(f->uniform_preprocessed.num_outcomes != 0)
+        ? uniform_prediv_local(s, state, bound, &(f->uniform_preprocessed))
+        : uniform_eo_mod_local(s, state, bound, &f->modulus);
+    u32 pos = num_flips;
+    for (;;) {
+        if (val < f->breadths[depth]) {
+            u32 ans = f->leaves_flat[location + val];
+            u64 mask = (1ull<<pos) - 1;
+            u64 recycle_state = mask & flips;
+            u64 recycle_bound = f->weights[ans];
+            recycle_state += recycle_bound & mask;
+            merge_state_local(state, bound, recycle_state, recycle_bound);
+            return ans;
+        }
+        location += f->breadths[depth];
+        --pos;
+        val = ((val - f->breadths[depth]) << 1) | ((flips >> pos) & 1);
+        ++depth;
+    }
+}
+
+u32 sample_fldr64_eo_r(struct rr_state *s, struct fldr64_eo_s* f) {
+    return sample_fldr64_eo_local(s, &s->unif_state, &s->unif_bound, f);
+}
+
+u32 sample_fldr64_eo(struct fldr64_eo_s* f) {
+    return sample_fldr64_eo_r(&rr_default, f);
+}
+
+void sample_fldr64_eo_n_r(struct rr_state *s, struct fldr64_eo_s *f, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_fldr64_eo_r.
+    const struct fldr64_eo_s t = *f;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    for (u64 i = 0; i < count; ++i) {
+        out[i] = sample_fldr64_eo_local(s, &state, &bound, &t);
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_fldr64_eo_n(struct fldr64_eo_s *f, u32 *out, u64 count) {
+    sample_fldr64_eo_n_r(&rr_default, f, out, count);
+}
+
+u64 bytes_fldr64_eo(struct fldr64_eo_s *x) {
+    return sizeof(*x) + ddg_block_bytes(x->length_breadths, x->length_leaves_flat, sizeof(u32),
+        x->length_weights, sizeof(x->weights[0]), 0, 0);
+}
+
+void free_fldr64_eo(struct fldr64_eo_s x) {
+    table_block_free(x.block);
 }
@@ -14,36 +14,135 @@
 #include "types.h"
 
 // flattened ALDR tree with entropy-optimal recycling
-// (except throwing away accept-reject Bernoulli information)
+// (except throwing away accept-reject Bernoulli information);
+// leaves_flat takes the index width of length_weights - 1, and the
+// amplified weights 4 bytes when they are all below 2^32 and 8 otherwise
 struct aldr_recycle_s {
     u32 length_breadths;
     u32 length_leaves_flat;
     u32 length_weights;
     u32 reject_weight;
+    u32 leaves_width;
+    u32 weights_width;
+    u32 *breadths;
+    void *leaves_flat;
+    void *weights;
+    void *block;
+};
+
+// FLDR but packing to the left so there is no rejection;
+// leaves_flat takes the index width of length_weights - 1
+struct fldr_eo_s {
+  u32 length_breadths;
+  u32 length_leaves_flat;
+  u32 length_weights;
+  u32 leaves_width;
+  struct uniform_preprocessed_s uniform_preprocessed;
+  u32 *breadths;
+  void *leaves_flat;
+  u32 *weights;
+  void *block;
+};
+
+// ALDR and FLDR with a table that resolves the first accel_bits levels
+// of the tree with one load; deeper leaves continue the walk from the
+// table entry. The samples and recycled state are those of the plain
+// samplers on the same weights.
+#define ACCEL_MAX_BITS 24
+
+struct aldr_recycle_accel_s {
+    struct aldr_recycle_s ddg;
+    u32 accel_bits;
+    u32 accel_location;
+    u64 *accel;
+};
+
+struct fldr_eo_accel_s {
+    struct fldr_eo_s ddg;
+    u32 accel_bits;
+    u32 accel_location;
+    u64 *accel;
+};
+
+// 64-bit weights, with total m <= RR_MAX_RANGE:
+// ALDR amplifies to K = max(k, min(2k, RR_MAX_RANGE_BITS)) levels,
+// and FLDR draws unif[0, m) by division when m >= 2^32
+struct aldr64_recycle_s {
+    u32 length_breadths;
+    u32 length_leaves_flat;
+    u32 length_weights;
+    u64 reject_weight;
     u32 *breadths;
     u32 *leaves_flat;
     u64 *weights;
+    void *block;
 };
 
-// FLDR but packing to the left so there is no rejection
-struct fldr_eo_s {
+struct fldr64_eo_s {
   u32 length_breadths;
   u32 length_leaves_flat;
   u32 length_weights;
+  u64 num_outcomes;
   struct uniform_preprocessed_s uniform_preprocessed;
+  struct uniform_modulus_s modulus;   // of num_outcomes
   u32 *breadths;
   u32 *leaves_flat;
-  u32 *weights;
+  u64 *weights;
+  void *block;
 };
 
 void free_aldr_recycle (struct aldr_recycle_s x);
 struct aldr_recycle_s preprocess_aldr_recycle(u32* a, u32 n);
+// Same table, built on num_threads threads (0 for every processor).
+struct aldr_recycle_s preprocess_aldr_recycle_parallel(u32* a, u32 n, u32 num_threads);
 u32 sample_aldr_recycle(struct aldr_recycle_s* f);
-u32 bytes_aldr_recycle(struct aldr_recycle_s *x);
+u32 sample_aldr_recycle_r(struct rr_state *s, struct aldr_recycle_s* f);
+void sample_aldr_recycle_n(struct aldr_recycle_s *f, u32 *out, u64 count);
+void sample_aldr_recycle_n_r(struct rr_state *s, struct aldr_recycle_s *f, u32 *out, u64 count);
+u64 bytes_aldr_recycle(struct aldr_recycle_s *x);
 
 void free_fldr_eo(struct fldr_eo_s x);
 struct fldr_eo_s preprocess_fldr_eo(u32* a, u32 n);
+// Same table, built on num_threads threads (0 for every processor).
+struct fldr_eo_s preprocess_fldr_eo_parallel(u32* a, u32 n, u32 num_threads);
 u32 sample_fldr_eo(struct fldr_eo_s* f);
-u32 bytes_fldr_eo(struct fldr_eo_s *x);
+u32 sample_fldr_eo_r(struct rr_state *s, struct fldr_eo_s* f);
+void sample_fldr_eo_n(struct fldr_eo_s *f, u32 *out, u64 count);
+void sample_fldr_eo_n_r(struct rr_state *s, struct fldr_eo_s *f, u32 *out, u64 count);
+u64 bytes_fldr_eo(struct fldr_eo_s *x);
+
+// accel_bits <= ACCEL_MAX_BITS, lowered to the depth of the tree;
+// the table takes 8 << accel_bits bytes.
+void free_aldr_recycle_accel(struct aldr_recycle_accel_s x);
+struct aldr_recycle_accel_s preprocess_aldr_recycle_accel(u32* a, u32 n, u32 accel_bits);
+u32 sample_aldr_recycle_accel(struct aldr_recycle_accel_s* x);
+u32 sample_aldr_recycle_accel_r(struct rr_state *s, struct aldr_recycle_accel_s* x);
+void sample_aldr_recycle_accel_n(struct aldr_recycle_accel_s *x, u32 *out, u64 count);
+void sample_aldr_recycle_accel_n_r(struct rr_state *s, struct aldr_recycle_accel_s *x, u32 *out, u64 count);
+u64 bytes_aldr_recycle_accel(struct aldr_recycle_accel_s *x);
+
+void free_fldr_eo_accel(struct fldr_eo_accel_s x);
+struct fldr_eo_accel_s preprocess_fldr_eo_accel(u32* a, u32 n, u32 accel_bits);
+u32 sample_fldr_eo_accel(struct fldr_eo_accel_s* x);
+u32 sample_fldr_eo_accel_r(struct rr_state *s, struct fldr_eo_accel_s* x);
+void sample_fldr_eo_accel_n(struct fldr_eo_accel_s *x, u32 *out, u64 count);
+void sample_fldr_eo_accel_n_r(struct rr_state *s, struct fldr_eo_accel_s *x, u32 *out, u64 count);
+u64 bytes_fldr_eo_accel(struct fldr_eo_accel_s *x);
+
+void free_aldr64_recycle(struct aldr64_recycle_s x);
+struct aldr64_recycle_s preprocess_aldr64_recycle(u64* a, u32 n);
+u32 sample_aldr64_recycle(struct aldr64_recycle_s* f);
+u32 sample_aldr64_recycle_r(struct rr_state *s, struct aldr64_recycle_s* f);
+void sample_aldr64_recycle_n(struct aldr64_recycle_s *f, u32 *out, u64 count);
+void sample_aldr64_recycle_n_r(struct rr_state *s, struct aldr64_recycle_s *f, u32 *out, u64 count);
+u64 bytes_aldr64_recycle(struct aldr64_recycle_s *x);
+
+void free_fldr64_eo(struct fldr64_eo_s x);
+struct fldr64_eo_s preprocess_fldr64_eo(u64* a, u32 n);
+u32 sample_fldr64_eo(struct fldr64_eo_s* f);
+u32 sample_fldr64_eo_r(struct rr_state *s, struct fldr64_eo_s* f);
+void sample_fldr64_eo_n(struct fldr64_eo_s *f, u32 *out, u64 count);
+void sample_fldr64_eo_n_r(struct rr_state *s, struct fldr64_eo_s *f, u32 *out, u64 count);
+u64 bytes_fldr64_eo(struct fldr64_eo_s *x);
 
 #endif
@@ -15,10 +15,12 @@
 #include "uniform.h"
 #include "types.h"
 #include "alias.h"
+#include "arena.h"
+#include "binarysearch.h"
+#include "parallel.h"
 
 void free_weighted_alias(struct weighted_alias_s x) {
-    free(x.aliases);
-    free(x.no_alias_odds);
+    table_block_free(x.block);
 }
 
 struct Aliases {
@@ -33,9 +35,9 @@ struct Aliases {
 /// the three data structures from getting in each other's way, it must
 /// be ensured that a single index is only ever in one of them at the
 /// same time.
-struct Aliases aliases_new(u32 n) {
+struct Aliases aliases_new(u32 *aliases) {
     return (struct Aliases) {
-        .aliases = calloc(n, sizeof(u32)),
+        .aliases = aliases,
         .smalls_head = UINT32_MAX,
         .bigs_head = UINT32_MAX
     };
@@ -83,7 +85,9 @@ void set_alias(struct Aliases *aliases, u32 idx, u32 alias) {
 /// - For any weight `w`: `w < 0` or `w > max` where `max = W::MAX /
 ///   weights.len()`.
 /// - The sum of weights is zero.
-struct weighted_alias_s preprocess_weighted_alias(int* a, int n) {
+///
+/// Fills aliases and no_alias_odds, of length n, and returns the sum of weights.
+static u32 build_weighted_alias(int* a, int n, u32 *aliases_out, u32 *no_alias_odds) {
     assert(n > 0);
     assert(n < UINT32_MAX);
     u32 max_weight_size = UINT32_MAX / n;
@@ -99,12 +103,11 @@ struct weighted_alias_s preprocess_weighted_alias(int* a, int n) {
     }
     assert(weight_sum >= 0);
 
-    u32 *no_alias_odds = calloc(n, sizeof(u32));
     for (u32 i = 0; i < n; ++i) {
         no_alias_odds[i] = a[i] * n;
     }
 
-    struct Aliases aliases = aliases_new(n);
+    struct Aliases aliases = aliases_new(aliases_out);
 
     // Split indices into those with small weights and those with big weights.
     for (u32 i = 0; i < n; ++i) {
@@ -137,88 +140,556 @@ struct weighted_alias_s preprocess_weighted_alias(int* a, int n) {
     while (!bigs_is_empty(&aliases)) {
         no_alias_odds[pop_big(&aliases)] = weight_sum;
     }
+    return weight_sum;
+}
 
-    return (struct weighted_alias_s) {
-        .length = n,
-        .weight_sum = weight_sum,
-        .aliases = aliases.aliases,
-        .no_alias_odds = no_alias_odds
+struct weighted_alias_s preprocess_weighted_alias(int* a, int n) {
+    struct weighted_alias_s x = { .length = n };
+    u64 bytes[] = {
+        (u64)x.length * sizeof(x.aliases[0]),
+        (u64)x.length * sizeof(x.no_alias_odds[0])
     };
+    void *arrays[2];
+    x.block = table_block_new(2, bytes, arrays);
+    x.aliases = arrays[0];
+    x.no_alias_odds = arrays[1];
+    x.weight_sum = build_weighted_alias(a, n, x.aliases, x.no_alias_odds);
+    x.length_modulus = uniform_modulus(x.length);
+    x.weight_sum_modulus = uniform_modulus(x.weight_sum);
+    return x;
 }
 
-int bytes_weighted_alias(struct weighted_alias_s *x) {
-    return
-        x->length * sizeof(x->aliases[0])
-            + x->length * sizeof(x->no_alias_odds[0])
-            + sizeof(x->length)
-            + sizeof(x->weight_sum);
+u64 bytes_weighted_alias(struct weighted_alias_s *x) {
+    u64 bytes[] = {
+        (u64)x->length * sizeof(x->aliases[0]),
+        (u64)x->length * sizeof(x->no_alias_odds[0])
+    };
+    return sizeof(*x) + table_block_bytes(2, bytes);
 }
 
-u32 sample_weighted_alias_recycle(struct weighted_alias_s *x) {
-    u32 uniform_index = uniform_eo(x->length);
-    if (bernoulli_eo(x->no_alias_odds[uniform_index], x->weight_sum)) {
+u32 sample_weighted_alias_recycle_r(struct rr_state *s, struct weighted_alias_s *x) {
+    u32 uniform_index = uniform_eo_mod_local(s, &s->unif_state, &s->unif_bound, &x->length_modulus);
+    if (bernoulli_eo_mod_local(s, &s->unif_state, &s->unif_bound,
+            x->no_alias_odds[uniform_index], &x->weight_sum_modulus)) {
         return uniform_index;
     } else {
         return x->aliases[uniform_index];
     }
 }
 
-struct weighted_alias_eo_s preprocess_weighted_alias_eo(int* a, int n) {
-    struct weighted_alias_s wai = preprocess_weighted_alias(a, n);
+u32 sample_weighted_alias_recycle(struct weighted_alias_s *x) {
+    return sample_weighted_alias_recycle_r(&rr_default, x);
+}
+
+void weighted_alias_eo_widths(struct weighted_alias_eo_s *x) {
+    x->aliases_width = index_width(x->length - 1);
+    x->odds_width = index_width(x->weight_sum);
+    x->offsets_width = (u64)x->length * x->weight_sum <= (1ull << 32) ? sizeof(u32) : sizeof(u64);
+}
+
+static struct weighted_alias_eo_s weighted_alias_eo_new(int* a, int n, u32 weight_sum) {
+    struct weighted_alias_eo_s x = { .length = n, .weight_sum = weight_sum };
+    weighted_alias_eo_widths(&x);
+    u64 bytes[] = {
+        (u64)x.length * sizeof(x.weights[0]),
+        (u64)x.length * x.aliases_width,
+        (u64)x.length * x.odds_width,
+        (u64)x.length * x.offsets_width
+    };
+    void *arrays[4];
+    x.block = table_block_new(4, bytes, arrays);
+    x.weights = arrays[0];
+    x.aliases = arrays[1];
+    x.no_alias_odds = arrays[2];
+    x.offsets = arrays[3];
+    memcpy(x.weights, a, n * sizeof(u32));
+    return x;
+}
+
+u32 fill_weighted_alias_eo(int* a, int n, u32 *aliases, u32 *no_alias_odds, u64 *offsets) {
+    u32 weight_sum = build_weighted_alias(a, n, aliases, no_alias_odds);
 
-    u64 *cumulative_sums = calloc(wai.length, sizeof(u64));
-    for (u32 i = 0; i < wai.length; ++i) {
-        cumulative_sums[i] = wai.no_alias_odds[i];
+    u64 *cumulative_sums = calloc(n, sizeof(u64));
+    for (u32 i = 0; i < n; ++i) {
+        cumulative_sums[i] = no_alias_odds[i];
     }
-    u64 *offsets = calloc(wai.length, sizeof(u64));
-    for (u32 i = 0; i < wai.length; ++i) {
-        if (wai.aliases[i] != UINT32_MAX) {
+    memset(offsets, 0, n * sizeof(u64));
+    for (u32 i = 0; i < n; ++i) {
+        if (aliases[i] != UINT32_MAX) {
             // might underflow but doesn't matter:
-            offsets[i] = cumulative_sums[wai.aliases[i]] - wai.no_alias_odds[i];
-            cumulative_sums[wai.aliases[i]] += wai.weight_sum - wai.no_alias_odds[i];
+            offsets[i] = cumulative_sums[aliases[i]] - no_alias_odds[i];
+            cumulative_sums[aliases[i]] += weight_sum - no_alias_odds[i];
         }
     }
     free(cumulative_sums);
-    u32 *weights = malloc(wai.length * sizeof(u32));
-    memcpy(weights, a, wai.length * sizeof(u32));
-
-    return (struct weighted_alias_eo_s) {
-        .length = wai.length,
-        .weight_sum = wai.weight_sum,
-        .weights = weights,
-        .aliases = wai.aliases,
-        .no_alias_odds = wai.no_alias_odds,
-        .offsets = offsets
+    return weight_sum;
+}
+
+// The builders write u32 aliases and odds and u64 offsets: into the
+// table when it has these widths, and otherwise into scratch arrays that
+// are narrowed into it afterwards. Offsets of 4 bytes are kept modulo
+// 2^32, which the sampler undoes.
+struct alias_eo_scratch_s {
+    u32 *aliases;
+    u32 *no_alias_odds;
+    u64 *offsets;
+};
+
+static struct alias_eo_scratch_s alias_eo_scratch(struct weighted_alias_eo_s *x) {
+    u64 n = x->length;
+    return (struct alias_eo_scratch_s) {
+        .aliases = x->aliases_width == sizeof(u32) ? x->aliases : malloc(n * sizeof(u32)),
+        .no_alias_odds = x->odds_width == sizeof(u32) ? x->no_alias_odds : malloc(n * sizeof(u32)),
+        .offsets = x->offsets_width == sizeof(u64) ? x->offsets : malloc(n * sizeof(u64))
     };
 }
 
-int bytes_weighted_alias_eo(struct weighted_alias_eo_s *x) {
-    return
-        x->length * sizeof(x->aliases[0])
-            + x->length * sizeof(x->no_alias_odds[0])
-            + x->length * sizeof(x->weights[0])
-            + x->length * sizeof(x->offsets[0])
-            + sizeof(x->length)
-            + sizeof(x->weight_sum);
+static void alias_eo_narrow(struct weighted_alias_eo_s *x, struct alias_eo_scratch_s w) {
+    if (w.aliases != x->aliases) {
+        index_pack(x->aliases, x->aliases_width, w.aliases, x->length);
+        free(w.aliases);
+    }
+    if (w.no_alias_odds != x->no_alias_odds) {
+        index_pack(x->no_alias_odds, x->odds_width, w.no_alias_odds, x->length);
+        free(w.no_alias_odds);
+    }
+    if (w.offsets != x->offsets) {
+        u32 *offsets = x->offsets;
+        for (u32 i = 0; i < x->length; ++i) {
+            offsets[i] = w.offsets[i];
+        }
+        free(w.offsets);
+    }
+}
+
+struct weighted_alias_eo_s preprocess_weighted_alias_eo(int* a, int n) {
+    u32 weight_sum = 0;
+    for (u32 i = 0; i < n; ++i) {
+        weight_sum += a[i];
+    }
+    struct weighted_alias_eo_s x = weighted_alias_eo_new(a, n, weight_sum);
+    struct alias_eo_scratch_s w = alias_eo_scratch(&x);
+    fill_weighted_alias_eo(a, n, w.aliases, w.no_alias_odds, w.offsets);
+    alias_eo_narrow(&x, w);
+    x.modulus = uniform_modulus((u64)x.length * x.weight_sum);
+    x.length_modulus = uniform_modulus(x.length);
+    return x;
+}
+
+// Parallel construction by a sweep over the two lists of indices, light
+// (no alias odds below weight_sum W) and heavy, each in index order.
+// With D(a) the deficit W - odds of lights before a and S(b) the excess
+// odds - W of heavies before b, the sweep takes light a before heavy b
+// when D(a) < S(b+1), so its order is a merge of the two lists by these
+// keys and each thread can start its share of the merge with a binary
+// search. Light a is aliased to the heavy b current when it is taken;
+// heavy b keeps W + S(b+1) - D(a) and is aliased to heavy b+1.
+struct alias_build_s {
+    const int *a;
+    u32 n;
+    u32 weight_sum;
+    u32 num_threads;
+    u32 *counts;        // lights and heavies of each thread
+    u64 *sums;          // deficit and excess of each thread
+    u32 num_lights;
+    u32 num_heavies;
+    u32 *lights;
+    u32 *heavies;
+    u64 *deficits;      // D, of length num_lights + 1
+    u64 *excesses;      // S, of length num_heavies + 1
+    u32 *aliases;
+    u32 *no_alias_odds;
+    u64 *offsets;
+};
+
+static void alias_count(void *p, u32 t, u32 num_threads) {
+    struct alias_build_s *b = p;
+    u64 begin, end;
+    parallel_range(b->n, t, num_threads, &begin, &end);
+    u32 num_lights = 0;
+    u64 deficit = 0;
+    u64 excess = 0;
+    for (u64 i = begin; i < end; ++i) {
+        u32 odds = b->a[i] * b->n;
+        if (odds < b->weight_sum) {
+            ++num_lights;
+            deficit += b->weight_sum - odds;
+        } else {
+            excess += odds - b->weight_sum;
+        }
+    }
+    b->counts[2 * t] = num_lights;
+    b->counts[2 * t + 1] = (end - begin) - num_lights;
+    b->sums[2 * t] = deficit;
+    b->sums[2 * t + 1] = excess;
+}
+
+static void alias_place(void *p, u32 t, u32 num_threads) {
+    // counts and sums hold where this thread starts in each list.
+    struct alias_build_s *b = p;
+    u64 begin, end;
+    parallel_range(b->n, t, num_threads, &begin, &end);
+    u32 light = b->counts[2 * t];
+    u32 heavy = b->counts[2 * t + 1];
+    u64 deficit = b->sums[2 * t];
+    u64 excess = b->sums[2 * t + 1];
+    for (u64 i = begin; i < end; ++i) {
+        u32 odds = b->a[i] * b->n;
+        if (odds < b->weight_sum) {
+            b->lights[light] = i;
+            b->deficits[light++] = deficit;
+            deficit += b->weight_sum - odds;
+        } else {
+            b->heavies[heavy] = i;
+            b->excesses[heavy++] = excess;
+            excess += odds - b->weight_sum;
+        }
+    }
+}
+
+static inline bool alias_light_first(const struct alias_build_s *b, u32 light, u32 heavy) {
+    return light < b->num_lights
+        && (heavy + 1 >= b->num_heavies || b->deficits[light] < b->excesses[heavy + 1]);
+}
+
+static void alias_sweep(void *p, u32 t, u32 num_threads) {
+    struct alias_build_s *b = p;
+    u64 begin, end;
+    parallel_range((u64)b->num_lights + b->num_heavies, t, num_threads, &begin, &end);
+    // Number of lights among the first begin steps of the merge.
+    u64 low = begin > b->num_heavies ? begin - b->num_heavies : 0;
+    u64 high = min(begin, (u64)b->num_lights);
+    while (low < high) {
+        u64 mid = (low + high + 1) / 2;
+        if (alias_light_first(b, mid - 1, begin - mid)) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    u32 light = low;
+    u32 heavy = begin - low;
+    u32 W = b->weight_sum;
+    for (u64 k = begin; k < end; ++k) {
+        if (alias_light_first(b, light, heavy)) {
+            u32 i = b->lights[light];
+            b->aliases[i] = b->heavies[heavy];
+            b->no_alias_odds[i] = b->a[i] * b->n;
+            b->offsets[i] = b->deficits[light] - b->excesses[heavy];
+            ++light;
+        } else if (heavy + 1 < b->num_heavies) {
+            u32 i = b->heavies[heavy];
+            b->aliases[i] = b->heavies[heavy + 1];
+            b->no_alias_odds[i] = W + b->excesses[heavy + 1] - b->deficits[light];
+            b->offsets[i] = 0;
+            ++heavy;
+        } else {
+            u32 i = b->heavies[heavy];
+            b->aliases[i] = UINT32_MAX;
+            b->no_alias_odds[i] = W;
+            b->offsets[i] = 0;
+            ++heavy;
+        }
+    }
+}
+
+static void alias_offsets(void *p, u32 t, u32 num_threads) {
+    // offsets holds where the taken odds start among those the alias
+    // gives away, which follow its own no alias odds.
+    struct alias_build_s *b = p;
+    u64 begin, end;
+    parallel_range(b->n, t, num_threads, &begin, &end);
+    for (u64 i = begin; i < end; ++i) {
+        if (b->aliases[i] != UINT32_MAX) {
+            // might underflow but doesn't matter:
+            b->offsets[i] += (u64)b->no_alias_odds[b->aliases[i]] - b->no_alias_odds[i];
+        }
+    }
+}
+
+struct weighted_alias_eo_s preprocess_weighted_alias_eo_parallel(int* a, int n, u32 num_threads) {
+    assert(n > 0);
+    assert(n < UINT32_MAX);
+    u32 max_weight_size = UINT32_MAX / n;
+    for (u32 i = 0; i < n; ++i) {
+        assert(0 <= a[i]);
+        assert(a[i] <= max_weight_size);
+    }
+    num_threads = parallel_threads(num_threads, n);
+    u32 *cdf = malloc((n + 1) * sizeof(u32));
+    fill_cdf(a, n, num_threads, cdf);
+    struct weighted_alias_eo_s x = weighted_alias_eo_new(a, n, cdf[n]);
+    free(cdf);
+    struct alias_eo_scratch_s w = alias_eo_scratch(&x);
+    struct alias_build_s b = {
+        .a = a,
+        .n = n,
+        .weight_sum = x.weight_sum,
+        .counts = malloc(2 * num_threads * sizeof(u32)),
+        .sums = malloc(2 * num_threads * sizeof(u64)),
+        .aliases = w.aliases,
+        .no_alias_odds = w.no_alias_odds,
+        .offsets = w.offsets
+    };
+
+    parallel_run(num_threads, alias_count, &b);
+    u32 num_lights = 0;
+    u32 num_heavies = 0;
+    u64 deficit = 0;
+    u64 excess = 0;
+    for (u32 t = 0; t < num_threads; ++t) {
+        u32 lights = b.counts[2 * t], heavies = b.counts[2 * t + 1];
+        u64 deficits = b.sums[2 * t], excesses = b.sums[2 * t + 1];
+        b.counts[2 * t] = num_lights;
+        b.counts[2 * t + 1] = num_heavies;
+        b.sums[2 * t] = deficit;
+        b.sums[2 * t + 1] = excess;
+        num_lights += lights;
+        num_heavies += heavies;
+        deficit += deficits;
+        excess += excesses;
+    }
+    b.num_lights = num_lights;
+    b.num_heavies = num_heavies;
+    b.lights = malloc(num_lights * sizeof(u32));
+    b.heavies = malloc(num_heavies * sizeof(u32));
+    b.deficits = malloc((num_lights + 1) * sizeof(u64));
+    b.excesses = malloc((num_heavies + 1) * sizeof(u64));
+    b.deficits[num_lights] = deficit;
+    b.excesses[num_heavies] = excess;
+    parallel_run(num_threads, alias_place, &b);
+    parallel_run(num_threads, alias_sweep, &b);
+    parallel_run(num_threads, alias_offsets, &b);
+
+    free(b.counts);
+    free(b.sums);
+    free(b.lights);
+    free(b.heavies);
+    free(b.deficits);
+    free(b.excesses);
+    alias_eo_narrow(&x, w);
+    x.modulus = uniform_modulus((u64)x.length * x.weight_sum);
+    x.length_modulus = uniform_modulus(x.length);
+    return x;
+}
+
+u64 bytes_weighted_alias_eo(struct weighted_alias_eo_s *x) {
+    u64 bytes[] = {
+        (u64)x->length * sizeof(x->weights[0]),
+        (u64)x->length * x->aliases_width,
+        (u64)x->length * x->odds_width,
+        (u64)x->length * x->offsets_width
+    };
+    return sizeof(*x) + table_block_bytes(4, bytes);
+}
+
+static inline u32 sample_weighted_alias_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct weighted_alias_eo_s *x, u32 aliases_width, u32 odds_width, u32 offsets_width) {
+    u64 uniform_index = uniform_eo_mod_local(s, state, bound, &x->modulus);
+    u64 uniform_weight = divide_modulus(uniform_index, &x->length_modulus, &uniform_index);
+    u64 no_alias_odds = index_get(x->no_alias_odds, odds_width, uniform_index);
+    if (uniform_weight < no_alias_odds) {
+        merge_state_local(state, bound, uniform_weight, (u64)x->weights[uniform_index] * (u64)x->length);
+        return uniform_index;
+    } else {
+        u32 alias = index_get(x->aliases, aliases_width, uniform_index);
+        // The sum is below length * weight_sum, so modulo 2^32 is exact
+        // when that fits 4-byte offsets.
+        u64 recycle_state = uniform_weight + index_get(x->offsets, offsets_width, uniform_index);
+        if (offsets_width == sizeof(u32)) {
+            recycle_state = (u32)recycle_state;
+        }
+        merge_state_local(state, bound, recycle_state, (u64)x->weights[alias] * (u64)x->length);
+        return alias;
+    }
+}
+
+u32 sample_weighted_alias_eo_r(struct rr_state *s, struct weighted_alias_eo_s *x) {
+    return sample_weighted_alias_eo_local(s, &s->unif_state, &s->unif_bound, x,
+        x->aliases_width, x->odds_width, x->offsets_width);
 }
 
 u32 sample_weighted_alias_eo(struct weighted_alias_eo_s *x) {
-    u64 uniform_index = uniform_eo((u64)x->length * (u64)x->weight_sum);
-    u64 uniform_weight = uniform_index / x->length;
-    uniform_index %= x->length;
+    return sample_weighted_alias_eo_r(&rr_default, x);
+}
+
+void sample_weighted_alias_eo_n_r(struct rr_state *s, struct weighted_alias_eo_s *x, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_weighted_alias_eo_r.
+    const struct weighted_alias_eo_s t = *x;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    SWITCH_INDEX_WIDTH(aliases_width, t.aliases_width,
+        SWITCH_INDEX_WIDTH(odds_width, t.odds_width,
+            SWITCH_WEIGHT_WIDTH(offsets_width, t.offsets_width,
+                for (u64 i = 0; i < count; ++i) {
+                    out[i] = sample_weighted_alias_eo_local(s, &state, &bound, &t,
+                        aliases_width, odds_width, offsets_width);
+                }
+            )
+        )
+    )
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_weighted_alias_eo_n(struct weighted_alias_eo_s *x, u32 *out, u64 count) {
+    sample_weighted_alias_eo_n_r(&rr_default, x, out, count);
+}
+
+void free_weighted_alias_eo(struct weighted_alias_eo_s x) {
+    table_block_free(x.block);
+}
+
+struct weighted_alias64_eo_s preprocess_weighted_alias64_eo(u64* a, u32 n) {
+    assert(n > 0);
+    assert(n < UINT32_MAX);
+    u128 sum = 0;
+    for (u32 i = 0; i < n; ++i) {
+        sum += a[i];
+    }
+    assert(0 < sum && sum <= RR_MAX_RANGE);
+    u64 weight_sum = sum;
+
+    // Offsets locate each column's share of its alias within
+    // unif[0, weights[alias] * n), which only fits the recycled state
+    // when the joint range length * weight_sum does.
+    bool joint = (u128)n * weight_sum <= RR_MAX_RANGE;
+    struct weighted_alias64_eo_s x = {
+        .length = n,
+        .weight_sum = weight_sum,
+        .modulus = uniform_modulus(joint ? (u64)n * weight_sum : 0),
+        .length_modulus = uniform_modulus(n),
+        .weight_sum_modulus = uniform_modulus(weight_sum)
+    };
+    u64 bytes[] = {
+        (u64)n * sizeof(x.weights[0]),
+        (u64)n * sizeof(x.aliases[0]),
+        (u64)n * sizeof(x.no_alias_odds[0]),
+        joint ? (u64)n * sizeof(x.offsets[0]) : 0
+    };
+    void *arrays[4];
+    x.block = table_block_new(4, bytes, arrays);
+    x.weights = arrays[0];
+    x.aliases = arrays[1];
+    x.no_alias_odds = arrays[2];
+    x.offsets = joint ? arrays[3] : NULL;
+    memcpy(x.weights, a, n * sizeof(u64));
+
+    // Scaled weights a[i] * n need 128 bits; after pairing,
+    // every column holds at most weight_sum.
+    u128 *odds = calloc(n, sizeof(u128));
+    for (u32 i = 0; i < n; ++i) {
+        odds[i] = (u128)a[i] * n;
+    }
+
+    struct Aliases aliases = aliases_new(x.aliases);
+    for (u32 i = 0; i < n; ++i) {
+        if (odds[i] < weight_sum) {
+            push_small(&aliases, i);
+        } else {
+            push_big(&aliases, i);
+        }
+    }
+    while (!smalls_is_empty(&aliases) && !bigs_is_empty(&aliases)) {
+        u32 small = pop_small(&aliases);
+        u32 big = pop_big(&aliases);
+        set_alias(&aliases, small, big);
+        odds[big] -= weight_sum - odds[small];
+        if (odds[big] < weight_sum) {
+            push_small(&aliases, big);
+        } else {
+            push_big(&aliases, big);
+        }
+    }
+    while (!smalls_is_empty(&aliases)) {
+        odds[pop_small(&aliases)] = weight_sum;
+    }
+    while (!bigs_is_empty(&aliases)) {
+        odds[pop_big(&aliases)] = weight_sum;
+    }
+
+    u64 *no_alias_odds = x.no_alias_odds;
+    for (u32 i = 0; i < n; ++i) {
+        no_alias_odds[i] = odds[i];
+    }
+    free(odds);
+
+    if (joint) {
+        u64 *cumulative_sums = malloc(n * sizeof(u64));
+        memcpy(cumulative_sums, no_alias_odds, n * sizeof(u64));
+        memset(x.offsets, 0, n * sizeof(u64));
+        for (u32 i = 0; i < n; ++i) {
+            if (x.aliases[i] != UINT32_MAX) {
+                // might underflow but doesn't matter:
+                x.offsets[i] = cumulative_sums[x.aliases[i]] - no_alias_odds[i];
+                cumulative_sums[x.aliases[i]] += weight_sum - no_alias_odds[i];
+            }
+        }
+        free(cumulative_sums);
+    }
+    return x;
+}
+
+static inline u32 sample_weighted_alias64_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct weighted_alias64_eo_s *x) {
+    if (unlikely(x->offsets == NULL)) {
+        // Range too large for joint recycling: draw the column,
+        // then recycle the Bernoulli choice within it.
+        u32 uniform_index = uniform_eo_mod_local(s, state, bound, &x->length_modulus);
+        if (bernoulli_eo_mod_local(s, state, bound, x->no_alias_odds[uniform_index], &x->weight_sum_modulus)) {
+            return uniform_index;
+        } else {
+            return x->aliases[uniform_index];
+        }
+    }
+    u64 uniform_index = uniform_eo_mod_local(s, state, bound, &x->modulus);
+    u64 uniform_weight = divide_modulus(uniform_index, &x->length_modulus, &uniform_index);
     u64 no_alias_odds = x->no_alias_odds[uniform_index];
     if (uniform_weight < no_alias_odds) {
-        merge_state(uniform_weight, (u64)x->weights[uniform_index] * (u64)x->length);
+        merge_state_local(state, bound, uniform_weight, x->weights[uniform_index] * x->length);
         return uniform_index;
     } else {
-        merge_state(uniform_weight + x->offsets[uniform_index], (u64)x->weights[x->aliases[uniform_index]] * (u64)x->length);
+        merge_state_local(state, bound, uniform_weight + x->offsets[uniform_index], x->weights[x->aliases[uniform_index]] * x->length);
         return x->aliases[uniform_index];
     }
 }
 
-void free_weighted_alias_eo(struct weighted_alias_eo_s x) {
-    free(x.weights);
-    free(x.aliases);
-    free(x.no_alias_odds);
-    free(x.offsets);
+u32 sample_weighted_alias64_eo_r(struct rr_state *s, struct weighted_alias64_eo_s *x) {
+    return sample_weighted_alias64_eo_local(s, &s->unif_state, &s->unif_bound, x);
+}
+
+u32 sample_weighted_alias64_eo(struct weighted_alias64_eo_s *x) {
+    return sample_weighted_alias64_eo_r(&rr_default, x);
+}
+
+void sample_weighted_alias64_eo_n_r(struct rr_state *s, struct weighted_alias64_eo_s *x, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_weighted_alias64_eo_r.
+    const struct weighted_alias64_eo_s t = *x;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    for (u64 i = 0; i < count; ++i) {
+        out[i] = sample_weighted_alias64_eo_local(s, &state, &bound, &t);
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_weighted_alias64_eo_n(struct weighted_alias64_eo_s *x, u32 *out, u64 count) {
+    sample_weighted_alias64_eo_n_r(&rr_default, x, out, count);
+}
+
+u64 bytes_weighted_alias64_eo(struct weighted_alias64_eo_s *x) {
+    u64 bytes[] = {
+        (u64)x->length * sizeof(x->weights[0]),
+        (u64)x->length * sizeof(x->aliases[0]),
+        (u64)x->length * sizeof(x->no_alias_odds[0]),
+        x->offsets ? (u64)x->length * sizeof(x->offsets[0]) : 0
+    };
+    return sizeof(*x) + table_block_bytes(4, bytes);
+}
+
+void free_weighted_alias64_eo(struct weighted_alias64_eo_s x) {
+    table_block_free(x.block);
 }
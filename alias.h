@@ -11,34 +11,85 @@
 #define ALIAS_H
 
 #include "types.h"
+#include "uniform.h"
 
 // weighted alias index arrays
 struct weighted_alias_s {
     u32 length;
     u32 weight_sum;
+    struct uniform_modulus_s length_modulus;
+    struct uniform_modulus_s weight_sum_modulus;
     u32 *aliases;
     u32 *no_alias_odds;
+    void *block;
 };
 
-// weighted alias index arrays with entropy-optimal recycling
+// weighted alias index arrays with entropy-optimal recycling;
+// aliases and no_alias_odds take the index widths of length - 1 and
+// weight_sum, and offsets 4 bytes when length * weight_sum <= 2^32
+// and 8 otherwise
 struct weighted_alias_eo_s {
     u32 length;
     u32 weight_sum;
+    u32 aliases_width;
+    u32 odds_width;
+    u32 offsets_width;
+    struct uniform_modulus_s modulus;   // of length * weight_sum
+    struct uniform_modulus_s length_modulus;
     u32 *weights;
+    void *aliases;
+    void *no_alias_odds;
+    void *offsets;
+    void *block;
+};
+
+// weighted alias index arrays with 64-bit weights, recycling
+// entropy-optimally when length * weight_sum <= RR_MAX_RANGE,
+// and only within the chosen column otherwise (offsets is NULL)
+struct weighted_alias64_eo_s {
+    u32 length;
+    u64 weight_sum;
+    struct uniform_modulus_s modulus;   // of length * weight_sum, if offsets
+    struct uniform_modulus_s length_modulus;
+    struct uniform_modulus_s weight_sum_modulus;
+    u64 *weights;
     u32 *aliases;
-    u32 *no_alias_odds;
+    u64 *no_alias_odds;
     u64 *offsets;
+    void *block;
 };
 
 void free_weighted_alias(struct weighted_alias_s x);
 struct weighted_alias_s preprocess_weighted_alias(int* a, int n);
-int bytes_weighted_alias(struct weighted_alias_s *x);
+u64 bytes_weighted_alias(struct weighted_alias_s *x);
 
 u32 sample_weighted_alias_recycle(struct weighted_alias_s *x);
+u32 sample_weighted_alias_recycle_r(struct rr_state *s, struct weighted_alias_s *x);
 
+// Set the array widths of x from its length and weight_sum.
+void weighted_alias_eo_widths(struct weighted_alias_eo_s *x);
 void free_weighted_alias_eo(struct weighted_alias_eo_s x);
 struct weighted_alias_eo_s preprocess_weighted_alias_eo(int* a, int n);
+// Built on num_threads threads (0 for every processor) by a sweep,
+// which gives another valid table than preprocess_weighted_alias_eo,
+// the same for any number of threads.
+struct weighted_alias_eo_s preprocess_weighted_alias_eo_parallel(int* a, int n, u32 num_threads);
 u32 sample_weighted_alias_eo(struct weighted_alias_eo_s *x);
-int bytes_weighted_alias_eo(struct weighted_alias_eo_s *x);
+u32 sample_weighted_alias_eo_r(struct rr_state *s, struct weighted_alias_eo_s *x);
+void sample_weighted_alias_eo_n(struct weighted_alias_eo_s *x, u32 *out, u64 count);
+void sample_weighted_alias_eo_n_r(struct rr_state *s, struct weighted_alias_eo_s *x, u32 *out, u64 count);
+u64 bytes_weighted_alias_eo(struct weighted_alias_eo_s *x);
+// Fill the aliases, no_alias_odds and offsets of the table of a, each of
+// length n, as preprocess_weighted_alias_eo does before narrowing them,
+// and return the sum of weights.
+u32 fill_weighted_alias_eo(int* a, int n, u32 *aliases, u32 *no_alias_odds, u64 *offsets);
+
+void free_weighted_alias64_eo(struct weighted_alias64_eo_s x);
+struct weighted_alias64_eo_s preprocess_weighted_alias64_eo(u64* a, u32 n);
+u32 sample_weighted_alias64_eo(struct weighted_alias64_eo_s *x);
+u32 sample_weighted_alias64_eo_r(struct rr_state *s, struct weighted_alias64_eo_s *x);
+void sample_weighted_alias64_eo_n(struct weighted_alias64_eo_s *x, u32 *out, u64 count);
+void sample_weighted_alias64_eo_n_r(struct rr_state *s, struct weighted_alias64_eo_s *x, u32 *out, u64 count);
+u64 bytes_weighted_alias64_eo(struct weighted_alias64_eo_s *x);
 
 #endif
@@ -0,0 +1,121 @@
+/*
+  Name:     arena.c
+  Purpose:  Allocating preprocessed tables in one block, from the heap or an arena.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <stdlib.h>
+
+#include "arena.h"
+
+static u64 align_table(u64 bytes) {
+    return (bytes + TABLE_ALIGN - 1) & ~(u64)(TABLE_ALIGN - 1);
+}
+
+static void *heap_alloc(void *ctx, u64 bytes) {
+    (void)ctx;
+    return aligned_alloc(TABLE_ALIGN, align_table(bytes));
+}
+
+static void heap_release(void *ctx, void *block) {
+    (void)ctx;
+    free(block);
+}
+
+static const struct table_alloc_s heap_table_alloc = {
+    .alloc = heap_alloc,
+    .release = heap_release
+};
+
+static __thread struct table_alloc_s current_alloc = {
+    .alloc = heap_alloc,
+    .release = heap_release
+};
+
+void set_table_alloc(const struct table_alloc_s *alloc) {
+    current_alloc = alloc ? *alloc : heap_table_alloc;
+}
+
+// arena
+
+static void *arena_alloc(void *ctx, u64 bytes) {
+    struct arena_s *arena = ctx;
+    u64 begin = align_table(arena->used);
+    if (begin > arena->size || bytes > arena->size - begin) {
+        return NULL;
+    }
+    arena->used = begin + bytes;
+    return arena->base + begin;
+}
+
+struct arena_s arena_new(u64 bytes) {
+    bytes = align_table(bytes);
+    return (struct arena_s) {
+        .base = aligned_alloc(TABLE_ALIGN, bytes),
+        .size = bytes,
+        .used = 0
+    };
+}
+
+struct table_alloc_s arena_table_alloc(struct arena_s *arena) {
+    return (struct table_alloc_s) {
+        .alloc = arena_alloc,
+        .release = NULL,
+        .ctx = arena
+    };
+}
+
+void arena_reset(struct arena_s *arena) {
+    arena->used = 0;
+}
+
+void free_arena(struct arena_s arena) {
+    free(arena.base);
+}
+
+// blocks
+
+struct table_block_s {
+    struct table_alloc_s alloc;
+};
+
+#define TABLE_BLOCK_HEADER align_table(sizeof(struct table_block_s))
+
+u64 table_block_bytes(u32 num_arrays, const u64 *bytes) {
+    u64 offset = TABLE_BLOCK_HEADER;
+    for (u32 i = 0; i < num_arrays; ++i) {
+        offset = align_table(offset + bytes[i]);
+    }
+    return offset;
+}
+
+void *table_block_new(u32 num_arrays, const u64 *bytes, void **arrays) {
+    u64 size = table_block_bytes(num_arrays, bytes);
+    struct table_alloc_s alloc = current_alloc;
+    struct table_block_s *block = alloc.alloc(alloc.ctx, size);
+    if (block == NULL) {
+        alloc = heap_table_alloc;
+        block = alloc.alloc(alloc.ctx, size);
+    }
+    block->alloc = alloc;
+    u64 offset = TABLE_BLOCK_HEADER;
+    for (u32 i = 0; i < num_arrays; ++i) {
+        arrays[i] = (char *)block + offset;
+        offset = align_table(offset + bytes[i]);
+    }
+    return block;
+}
+
+void table_block_free(void *block) {
+    // Tables mapped from files have no block.
+    if (block == NULL) {
+        return;
+    }
+    struct table_alloc_s alloc = ((struct table_block_s *)block)->alloc;
+    if (alloc.release) {
+        alloc.release(alloc.ctx, block);
+    }
+}
@@ -0,0 +1,55 @@
+/*
+  Name:     arena.h
+  Purpose:  Allocating preprocessed tables in one block, from the heap or an arena.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "types.h"
+
+// Every preprocess_* places the arrays of its table in one block: a
+// header that records the allocator, then each array at a multiple of
+// TABLE_ALIGN bytes. The table keeps the block in its block field, and
+// free_* releases it in one step.
+#define TABLE_ALIGN 64
+
+struct table_alloc_s {
+    // Return bytes bytes aligned to TABLE_ALIGN, or NULL when out of space.
+    void *(*alloc)(void *ctx, u64 bytes);
+    // Release a block returned by alloc, or nothing when NULL.
+    void (*release)(void *ctx, void *block);
+    void *ctx;
+};
+
+// Allocate the tables preprocessed on this thread with alloc, or with
+// the heap when alloc is NULL. A block that alloc cannot provide comes
+// from the heap instead. Blocks remember their allocator, so free_*
+// works after the allocator is changed again.
+void set_table_alloc(const struct table_alloc_s *alloc);
+
+// Bump allocation from one buffer. Tables in an arena are released
+// together by arena_reset or free_arena; free_* on them does nothing.
+struct arena_s {
+    char *base;
+    u64 size;
+    u64 used;
+};
+
+struct arena_s arena_new(u64 bytes);
+struct table_alloc_s arena_table_alloc(struct arena_s *arena);
+void arena_reset(struct arena_s *arena);
+void free_arena(struct arena_s arena);
+
+// Bytes of a block holding num_arrays arrays of bytes[i] bytes each.
+u64 table_block_bytes(u32 num_arrays, const u64 *bytes);
+// Allocate such a block from the allocator of this thread, and point
+// arrays[i] to each array in it.
+void *table_block_new(u32 num_arrays, const u64 *bytes, void **arrays);
+void table_block_free(void *block);
+
+#endif
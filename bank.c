@@ -0,0 +1,334 @@
+/*
+  Name:     bank.c
+  Purpose:  Packing many small distributions in one table.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alias.h"
+#include "arena.h"
+#include "bank.h"
+#include "binarysearch.h"
+#include "parallel.h"
+#include "uniform.h"
+
+// Records are arrays of u32 words, padded to an even length so that the
+// u64 fields of each record are aligned. Word 0 holds the kind in its
+// low 2 bits and the number of outcomes n above them.
+//
+// BANK_LOOKUP  m, inverse of m (u64), cdf[n + 1], lookup[m]
+// BANK_ALIAS   weight_sum, inverses of n * weight_sum and n (u64),
+//              offsets[n] (u64), weights[n], aliases[n], no_alias_odds[n]
+// BANK_FLDR    num_levels, uniform_preprocessed (6 words), weights[n],
+//              breadths[num_levels], leaves_flat[]
+// The inverses are those of uniform_modulus, so that no kind of record
+// divides when sampled.
+#define BANK_HEADER_LOOKUP 4
+#define BANK_HEADER_ALIAS 6
+#define BANK_HEADER_FLDR 8
+
+_Static_assert(sizeof(struct uniform_preprocessed_s) == 6 * sizeof(u32),
+    "uniform_preprocessed_s must fill words 2 to 7 of an FLDR record");
+
+// Only the inverse of a modulus is stored, in 2 words; its n is known
+// from the record.
+static void store_inverse(u32 *r, struct uniform_modulus_s m) {
+    *(u64 *)r = m.inverse;
+}
+
+static inline struct uniform_modulus_s load_modulus(const u32 *r, u64 n) {
+    return (struct uniform_modulus_s) { .n = n, .inverse = *(const u64 *)r };
+}
+
+static u64 even_words(u64 words) {
+    return (words + 1) & ~(u64)1;
+}
+
+// Kind and length in words of the record of a[0 .. n).
+static enum bank_kind plan_record(const u32 *a, u32 n, u64 *words) {
+    assert(n > 0);
+    assert(n < (1u << 30));
+    u64 m = 0;
+    u64 num_leaves = 0;
+    for (u32 i = 0; i < n; ++i) {
+        m += a[i];
+        num_leaves += __builtin_popcount(a[i]);
+    }
+    assert(m > 0);
+    assert(m < (1u << 31));
+
+    enum bank_kind kind = BANK_LOOKUP;
+    *words = even_words(BANK_HEADER_LOOKUP + (n + 1) + m);
+    // The alias table needs n * m < 2^32, and uniform_preprocess m >= 2.
+    if ((u64)n * m <= UINT32_MAX) {
+        u64 alias = even_words(BANK_HEADER_ALIAS + 5ull * n);
+        if (alias < *words) {
+            kind = BANK_ALIAS;
+            *words = alias;
+        }
+    }
+    if (m >= 2) {
+        u32 k = 32 - __builtin_clz(m) - (0 == (m & (m-1)));
+        u64 fldr = even_words(BANK_HEADER_FLDR + n + (k + 1) + num_leaves);
+        if (fldr < *words) {
+            kind = BANK_FLDR;
+            *words = fldr;
+        }
+    }
+    return kind;
+}
+
+static void fill_record(u32 *a, u32 n, enum bank_kind kind, u32 *r) {
+    r[0] = kind | (n << 2);
+    switch (kind) {
+    case BANK_LOOKUP: {
+        u32 *cdf = r + BANK_HEADER_LOOKUP;
+        u32 *lookup = cdf + n + 1;
+        fill_cdf((int *)a, n, 1, cdf);
+        r[1] = cdf[n];
+        store_inverse(r + 2, uniform_modulus(r[1]));
+        for (u32 i = 0; i < n; ++i) {
+            for (u32 j = cdf[i]; j < cdf[i+1]; ++j) {
+                lookup[j] = i;
+            }
+        }
+        break;
+    }
+    case BANK_ALIAS: {
+        u64 *offsets = (u64 *)(r + BANK_HEADER_ALIAS);
+        u32 *weights = r + BANK_HEADER_ALIAS + 2 * n;
+        u32 *aliases = weights + n;
+        u32 *no_alias_odds = aliases + n;
+        memcpy(weights, a, n * sizeof(u32));
+        r[1] = fill_weighted_alias_eo((int *)a, n, aliases, no_alias_odds, offsets);
+        store_inverse(r + 2, uniform_modulus((u64)n * r[1]));
+        store_inverse(r + 4, uniform_modulus(n));
+        break;
+    }
+    case BANK_FLDR: {
+        // The leaves of level j are the outcomes with bit k - j set,
+        // in increasing order, as in preprocess_fldr_eo.
+        u32 m = 0;
+        for (u32 i = 0; i < n; ++i) {
+            m += a[i];
+        }
+        u32 k = 32 - __builtin_clz(m) - (0 == (m & (m-1)));
+        u32 num_levels = k + 1;
+        struct uniform_preprocessed_s u = uniform_preprocess(m);
+        u32 *weights = r + BANK_HEADER_FLDR;
+        u32 *breadths = weights + n;
+        u32 *leaves_flat = breadths + num_levels;
+        r[1] = num_levels;
+        // Field by field, so that its padding word stays zeroed.
+        struct uniform_preprocessed_s *header = (struct uniform_preprocessed_s *)(r + 2);
+        header->num_outcomes = u.num_outcomes;
+        header->quotient = u.quotient;
+        header->not_remainder = u.not_remainder;
+        header->inverse = u.inverse;
+        memcpy(weights, a, n * sizeof(u32));
+        u32 location = 0;
+        for (u32 j = 0; j < num_levels; ++j) {
+            u32 bit = k - j;
+            breadths[j] = 0;
+            for (u32 i = 0; i < n; ++i) {
+                if ((a[i] >> bit) & 1) {
+                    leaves_flat[location++] = i;
+                    ++breadths[j];
+                }
+            }
+        }
+        break;
+    }
+    }
+}
+
+// Each thread plans, then fills, a contiguous range of rows. The first
+// pass only sums the words of each range, so the offset of every row is
+// known in the second without storing the plans.
+struct bank_build_s {
+    u64 *row_offsets;
+    u32 *weights;
+    u32 num_rows;
+    u64 *sums;          // words of each thread, then their prefix sums
+    u64 *index;
+    u32 *records;
+};
+
+static void bank_plan(void *p, u32 t, u32 num_threads) {
+    struct bank_build_s *b = p;
+    u64 begin, end;
+    parallel_range(b->num_rows, t, num_threads, &begin, &end);
+    u64 sum = 0;
+    for (u64 id = begin; id < end; ++id) {
+        u64 words;
+        plan_record(b->weights + b->row_offsets[id],
+            b->row_offsets[id+1] - b->row_offsets[id], &words);
+        sum += words;
+    }
+    b->sums[t] = sum;
+}
+
+static void bank_fill(void *p, u32 t, u32 num_threads) {
+    struct bank_build_s *b = p;
+    u64 begin, end;
+    parallel_range(b->num_rows, t, num_threads, &begin, &end);
+    u64 location = b->sums[t];
+    for (u64 id = begin; id < end; ++id) {
+        u32 *a = b->weights + b->row_offsets[id];
+        u32 n = b->row_offsets[id+1] - b->row_offsets[id];
+        u64 words;
+        enum bank_kind kind = plan_record(a, n, &words);
+        b->index[id] = location;
+        fill_record(a, n, kind, b->records + location);
+        location += words;
+    }
+}
+
+struct bank_s preprocess_bank(u64 *row_offsets, u32 *weights, u32 num_rows) {
+    return preprocess_bank_parallel(row_offsets, weights, num_rows, 1);
+}
+
+struct bank_s preprocess_bank_parallel(u64 *row_offsets, u32 *weights, u32 num_rows, u32 num_threads) {
+    num_threads = parallel_threads(num_threads, num_rows);
+    struct bank_build_s b = {
+        .row_offsets = row_offsets,
+        .weights = weights,
+        .num_rows = num_rows,
+        .sums = calloc(num_threads, sizeof(u64))
+    };
+    parallel_run(num_threads, bank_plan, &b);
+    u64 length_records = 0;
+    for (u32 t = 0; t < num_threads; ++t) {
+        u64 words = b.sums[t];
+        b.sums[t] = length_records;
+        length_records += words;
+    }
+
+    struct bank_s x = { .num_rows = num_rows, .length_records = length_records };
+    u64 bytes[] = {
+        ((u64)x.num_rows + 1) * sizeof(x.index[0]),
+        x.length_records * sizeof(x.records[0])
+    };
+    void *arrays[2];
+    x.block = table_block_new(2, bytes, arrays);
+    x.index = arrays[0];
+    x.records = arrays[1];
+    // Padding words are zeroed so that equal banks have equal bytes.
+    memset(x.records, 0, bytes[1]);
+    x.index[num_rows] = length_records;
+
+    b.index = x.index;
+    b.records = x.records;
+    parallel_run(num_threads, bank_fill, &b);
+    free(b.sums);
+    return x;
+}
+
+static inline u32 sample_bank_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct bank_s *x, u32 id) {
+    const u32 *r = x->records + x->index[id];
+    u32 n = r[0] >> 2;
+    switch (r[0] & 3) {
+    case BANK_LOOKUP: {
+        // As sample_lookup_eo.
+        const struct uniform_modulus_s m = load_modulus(r + 2, r[1]);
+        const u32 *cdf = r + BANK_HEADER_LOOKUP;
+        const u32 *lookup = cdf + n + 1;
+        u32 uniform_index = uniform_eo_mod_local(s, state, bound, &m);
+        u32 result = lookup[uniform_index];
+        merge_state_local(state, bound, uniform_index - cdf[result], cdf[result + 1] - cdf[result]);
+        return result;
+    }
+    case BANK_ALIAS: {
+        // As sample_weighted_alias_eo.
+        const struct uniform_modulus_s m = load_modulus(r + 2, (u64)n * r[1]);
+        const struct uniform_modulus_s m_length = load_modulus(r + 4, n);
+        const u64 *offsets = (const u64 *)(r + BANK_HEADER_ALIAS);
+        const u32 *weights = r + BANK_HEADER_ALIAS + 2 * n;
+        const u32 *aliases = weights + n;
+        const u32 *no_alias_odds = aliases + n;
+        u64 uniform_index = uniform_eo_mod_local(s, state, bound, &m);
+        u64 uniform_weight = divide_modulus(uniform_index, &m_length, &uniform_index);
+        if (uniform_weight < no_alias_odds[uniform_index]) {
+            merge_state_local(state, bound, uniform_weight, (u64)weights[uniform_index] * n);
+            return uniform_index;
+        }
+        u32 alias = aliases[uniform_index];
+        merge_state_local(state, bound, uniform_weight + offsets[uniform_index], (u64)weights[alias] * n);
+        return alias;
+    }
+    default: {
+        // As sample_fldr_eo.
+        u32 num_levels = r[1];
+        const struct uniform_preprocessed_s *u = (const void *)(r + 2);
+        const u32 *weights = r + BANK_HEADER_FLDR;
+        const u32 *breadths = weights + n;
+        const u32 *leaves_flat = breadths + num_levels;
+        u32 flips = uniform_prediv_local(s, state, bound, u);
+        u32 depth = 0;
+        u32 location = 0;
+        u32 val = 0;
+        u32 pos = num_levels - 1;
+        for (;;) {
+            if (val < breadths[depth]) {
+                u32 ans = leaves_flat[location + val];
+                u32 mask = (1u<<pos) - 1;
+                u32 recycle_bound = weights[ans];
+                merge_state_local(state, bound, (mask & flips) + (recycle_bound & mask), recycle_bound);
+                return ans;
+            }
+            location += breadths[depth];
+            --pos;
+            val = ((val - breadths[depth]) << 1) | ((flips >> pos) & 1);
+            ++depth;
+        }
+    }
+    }
+}
+
+u32 sample_bank_r(struct rr_state *s, struct bank_s *x, u32 id) {
+    return sample_bank_local(s, &s->unif_state, &s->unif_bound, x, id);
+}
+
+u32 sample_bank(struct bank_s *x, u32 id) {
+    return sample_bank_r(&rr_default, x, id);
+}
+
+void sample_bank_n_r(struct rr_state *s, struct bank_s *x, const u32 *ids, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_bank_r.
+    const struct bank_s t = *x;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    for (u64 i = 0; i < count; ++i) {
+        out[i] = sample_bank_local(s, &state, &bound, &t, ids[i]);
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_bank_n(struct bank_s *x, const u32 *ids, u32 *out, u64 count) {
+    sample_bank_n_r(&rr_default, x, ids, out, count);
+}
+
+enum bank_kind bank_row_kind(struct bank_s *x, u32 id) {
+    return x->records[x->index[id]] & 3;
+}
+
+void free_bank(struct bank_s x) {
+    table_block_free(x.block);
+}
+
+u64 bytes_bank(struct bank_s *x) {
+    u64 bytes[] = {
+        ((u64)x->num_rows + 1) * sizeof(x->index[0]),
+        x->length_records * sizeof(x->records[0])
+    };
+    return sizeof(*x) + table_block_bytes(2, bytes);
+}
@@ -0,0 +1,51 @@
+/*
+  Name:     bank.h
+  Purpose:  Packing many small distributions in one table.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#ifndef BANK_H
+#define BANK_H
+
+#include "types.h"
+#include "uniform.h"
+
+// A bank holds one record per distribution (row), back to back in
+// records, and the word offset of each record in index. Row id has the
+// weights[row_offsets[id] .. row_offsets[id+1]), as in a CSR matrix.
+// Each record is encoded as a lookup table, an alias table or an FLDR
+// tree, whichever takes the fewest words, and gives the same samples
+// and recycled state as sample_lookup_eo, sample_weighted_alias_eo or
+// sample_fldr_eo on a table of that row.
+enum bank_kind {
+    BANK_LOOKUP,
+    BANK_ALIAS,
+    BANK_FLDR
+};
+
+struct bank_s {
+    u32 num_rows;
+    u64 length_records;
+    u64 *index;         // num_rows + 1 offsets, in words of records
+    u32 *records;
+    void *block;
+};
+
+// Each row must have between 1 and 2^30 - 1 weights, summing to
+// between 1 and 2^31 - 1.
+struct bank_s preprocess_bank(u64 *row_offsets, u32 *weights, u32 num_rows);
+// Same table, built on num_threads threads (0 for every processor).
+struct bank_s preprocess_bank_parallel(u64 *row_offsets, u32 *weights, u32 num_rows, u32 num_threads);
+u32 sample_bank(struct bank_s *x, u32 id);
+u32 sample_bank_r(struct rr_state *s, struct bank_s *x, u32 id);
+// out[i] is a sample of row ids[i].
+void sample_bank_n(struct bank_s *x, const u32 *ids, u32 *out, u64 count);
+void sample_bank_n_r(struct rr_state *s, struct bank_s *x, const u32 *ids, u32 *out, u64 count);
+enum bank_kind bank_row_kind(struct bank_s *x, u32 id);
+void free_bank(struct bank_s x);
+u64 bytes_bank(struct bank_s *x);
+
+#endif
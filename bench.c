@@ -0,0 +1,650 @@
+/*
+  Name:     bench.c
+  Purpose:  Benchmarks for sampling with randomness recycling.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "source.h"
+#include "uniform.h"
+#include "aldr.h"
+#include "alias.h"
+#include "lookup.h"
+#include "binarysearch.h"
+#include "lanes.h"
+#include "shuffle.h"
+
+// Count the words drawn from an underlying source, to measure
+// the number of random bits consumed per sample.
+struct bit_source_s counted_source;
+u64 counted_words = 0;
+
+void fill_counted(struct bit_source_s *source, u64 *buffer, u32 n) {
+    counted_words += n;
+    counted_source.fill(&counted_source, buffer, n);
+}
+
+void bench_state_init(struct rr_state *s, u64 seed) {
+    counted_source = source_new_seeded(SOURCE_XOSHIRO256, seed);
+    counted_words = 0;
+    rr_state_init(s, (struct bit_source_s) {
+        .kind = SOURCE_XOSHIRO256,
+        .fill = fill_counted
+    });
+}
+
+f64 bench_bits_consumed(struct rr_state *s) {
+    // Bits pulled from the source, less the bits still buffered
+    // and the entropy still held in the recycled state.
+    u64 unused_words = SOURCE_BUFFER_WORDS - s->flip_buffer_pos;
+    f64 pulled = 64.0 * (counted_words - unused_words) - s->flip_pos;
+    return pulled - log2((f64)s->unif_bound);
+}
+
+void bench_lanes_init(struct rr_lanes_s *l, u64 seed) {
+    counted_source = source_new_seeded(SOURCE_XOSHIRO256, seed);
+    counted_words = 0;
+    rr_lanes_init(l, (struct bit_source_s) {
+        .kind = SOURCE_XOSHIRO256,
+        .fill = fill_counted
+    });
+}
+
+f64 bench_lanes_bits_consumed(struct rr_lanes_s *l) {
+    f64 pulled = 64.0 * (counted_words - (l->buffer_end - l->buffer_pos));
+    for (u32 j = 0; j < RR_LANES; ++j) {
+        pulled -= l->flip_pos[j] + log2((f64)l->unif_bound[j]);
+    }
+    return pulled;
+}
+
+f64 now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+// Distribution families.
+// Weights are scaled so that every sampler accepts them:
+// the sum is below 2^31 and each weight is at most UINT32_MAX / n.
+
+void weights_uniform(u32 *a, u32 n) {
+    for (u32 i = 0; i < n; ++i) {
+        a[i] = 1;
+    }
+}
+
+void weights_zipf(u32 *a, u32 n) {
+    f64 harmonic = log((f64)n) + 1;
+    u64 top = min((u64)(UINT32_MAX / n), (u64)((INT32_MAX - n) / harmonic));
+    for (u32 i = 0; i < n; ++i) {
+        a[i] = max((u64)1, top / (i + 1));
+    }
+}
+
+void weights_geometric(u32 *a, u32 n) {
+    u64 top = min((u64)(UINT32_MAX / n), (u64)(INT32_MAX - n) / 2);
+    for (u32 i = 0; i < n; ++i) {
+        a[i] = max((u64)1, i < 64 ? top >> i : 0);
+    }
+}
+
+void weights_random(u32 *a, u32 n) {
+    u32 top = min(UINT32_MAX / n, INT32_MAX / n);
+    u64 seed = 0x5eed;
+    for (u32 i = 0; i < n; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        a[i] = 1 + (seed >> 33) % top;
+    }
+}
+
+void weights_dominant(u32 *a, u32 n) {
+    weights_uniform(a, n);
+    a[0] = min(UINT32_MAX / n, INT32_MAX - n);
+}
+
+struct family_s {
+    const char *name;
+    void (*fill)(u32 *a, u32 n);
+};
+
+const struct family_s families[] = {
+    { "uniform", weights_uniform },
+    { "zipf", weights_zipf },
+    { "geometric", weights_geometric },
+    { "random", weights_random },
+    { "dominant", weights_dominant },
+};
+
+f64 entropy(u32 *a, u32 n) {
+    f64 m = 0;
+    for (u32 i = 0; i < n; ++i) {
+        m += a[i];
+    }
+    f64 h = 0;
+    for (u32 i = 0; i < n; ++i) {
+        if (a[i] > 0) {
+            f64 p = a[i] / m;
+            h -= p * log2(p);
+        }
+    }
+    return h;
+}
+
+// Upper bounds on table sizes, to skip tables over the memory budget
+// before building them.
+
+u64 leaves_fldr(u32 *a, u32 n) {
+    u64 leaves = 0;
+    for (u32 i = 0; i < n; ++i) {
+        leaves += __builtin_popcount(a[i]);
+    }
+    return leaves;
+}
+
+u64 leaves_aldr(u32 *a, u32 n, u64 m) {
+    u32 k = 64 - __builtin_clzll(m) - (0 == (m & (m-1)));
+    u64 c = (1ull << (2 * k)) / m;
+    u64 leaves = 0;
+    for (u32 i = 0; i < n; ++i) {
+        leaves += __builtin_popcountll(c * a[i]);
+    }
+    return leaves;
+}
+
+struct lookup_guide_s preprocess_lookup_guide_default(u32 *a, u32 n) {
+    return preprocess_lookup_guide(a, n, 0);
+}
+
+struct fldr_eo_accel_s preprocess_fldr_eo_accel_default(u32 *a, u32 n) {
+    return preprocess_fldr_eo_accel(a, n, 12);
+}
+
+struct aldr_recycle_accel_s preprocess_aldr_recycle_accel_default(u32 *a, u32 n) {
+    return preprocess_aldr_recycle_accel(a, n, 12);
+}
+
+// Time building the same table on num_threads threads, or leave the
+// preprocess_parallel_s column empty.
+#define BUILD_PARALLEL(struct_name, func_preprocess_parallel, func_free) { \
+        f64 t = now(); \
+        struct struct_name y = func_preprocess_parallel((void *)a, n, num_threads); \
+        t_parallel = now() - t; \
+        func_free(y); \
+    }
+#define NO_BUILD_PARALLEL
+
+void print_seconds(f64 t) {
+    if (t >= 0) {
+        printf("%.6f", t);
+    }
+}
+
+#define BENCH(key, \
+        struct_name, \
+        estimate, \
+        func_preprocess, \
+        build_parallel, \
+        func_sample, \
+        func_sample_n, \
+        func_bytes, \
+        func_free) \
+    if (estimate <= max_bytes) { \
+        f64 t0 = now(); \
+        struct struct_name x = func_preprocess((void *)a, n); \
+        f64 t1 = now(); \
+        f64 t_parallel = -1; \
+        build_parallel \
+        bench_state_init(s, 1); \
+        u32 sink = 0; \
+        f64 t2 = now(); \
+        for (u32 i = 0; i < num_samples; ++i) { \
+            sink += func_sample(s, &x); \
+        } \
+        f64 t3 = now(); \
+        bench_state_init(s, 1); \
+        f64 t4 = now(); \
+        func_sample_n(s, &x, out, num_samples); \
+        f64 t5 = now(); \
+        sink += out[num_samples - 1]; \
+        printf("%s,%u,%s,%.6f,", family, n, key, t1 - t0); \
+        print_seconds(t_parallel); \
+        printf(",%lu,%.3f,%.3f,%.4f,%.4f\n", (u64)func_bytes(&x), \
+            1e9 * (t3 - t2) / num_samples, \
+            1e9 * (t5 - t4) / num_samples, \
+            bench_bits_consumed(s) / num_samples, h); \
+        fflush(stdout); \
+        func_free(x); \
+        volatile u32 keep = sink; \
+        (void)keep; \
+    }
+
+// Multi-lane samplers have no single-sample form; both timing
+// columns report the same batch.
+#define BENCH_LANES(key, \
+        struct_name, \
+        estimate, \
+        func_preprocess, \
+        build_parallel, \
+        func_sample_lanes, \
+        func_bytes, \
+        func_free) \
+    if (estimate <= max_bytes) { \
+        f64 t0 = now(); \
+        struct struct_name x = func_preprocess((void *)a, n); \
+        f64 t1 = now(); \
+        f64 t_parallel = -1; \
+        build_parallel \
+        bench_lanes_init(l, 1); \
+        f64 t2 = now(); \
+        func_sample_lanes(l, &x, out, num_samples); \
+        f64 t3 = now(); \
+        printf("%s,%u,%s,%.6f,", family, n, key, t1 - t0); \
+        print_seconds(t_parallel); \
+        printf(",%lu,%.3f,%.3f,%.4f,%.4f\n", (u64)func_bytes(&x), \
+            1e9 * (t3 - t2) / num_samples, \
+            1e9 * (t3 - t2) / num_samples, \
+            bench_lanes_bits_consumed(l) / num_samples, h); \
+        fflush(stdout); \
+        func_free(x); \
+        volatile u32 keep = out[num_samples - 1]; \
+        (void)keep; \
+    }
+
+// Fisher-Yates with one uniform_eo per step, to compare with shuffle_eo.
+void shuffle_naive_eo_r(struct rr_state *s, u32 *a, u64 n) {
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    for (u64 i = n - 1; i > 0 && n > 1; --i) {
+        u64 j = uniform_eo_local(s, &state, &bound, i + 1);
+        u32 t = a[i];
+        a[i] = a[j];
+        a[j] = t;
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void bench_shuffle(u64 max_n) {
+    struct rr_state *s = malloc(sizeof(*s));
+    printf("n,method,ns_per_element,bits_per_element,entropy_bits\n");
+    for (u64 n = 1000000; n <= max_n; n *= 10) {
+        u32 *a = malloc(n * sizeof(*a));
+        // log2(n!) / n
+        f64 h = lgamma((f64)n + 1) / log(2) / n;
+        for (u32 method = 0; method < 3; ++method) {
+            for (u64 i = 0; i < n; ++i) {
+                a[i] = i;
+            }
+            bench_state_init(s, 1);
+            f64 t0 = now();
+            const char *name;
+            if (method == 0) {
+                name = "naive";
+                shuffle_naive_eo_r(s, a, n);
+            } else if (method == 1) {
+                name = "shuffle_eo";
+                shuffle_eo_r(s, a, n, sizeof(*a));
+            } else {
+                name = "random_permutation_eo";
+                random_permutation_eo_r(s, a, n);
+            }
+            f64 t1 = now();
+            printf("%lu,%s,%.3f,%.4f,%.4f\n", n, name, 1e9 * (t1 - t0) / n,
+                bench_bits_consumed(s) / n, h);
+            fflush(stdout);
+        }
+        free(a);
+    }
+    free(s);
+}
+
+// Hardware counters of this thread in user space, from perf_event_open.
+// Each is opened on its own, so that a counter the machine lacks only
+// empties its column; the kernel multiplexes counters that do not fit
+// the PMU together, and their counts are scaled by the time they ran.
+struct perf_counter_s {
+    const char *name;
+    u32 type;
+    u64 config;
+};
+
+#define HW_CACHE_READ_MISS(cache) (PERF_COUNT_HW_CACHE_##cache \
+    | (PERF_COUNT_HW_CACHE_OP_READ << 8) \
+    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+const struct perf_counter_s perf_counters[] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "l1d_misses", PERF_TYPE_HW_CACHE, HW_CACHE_READ_MISS(L1D) },
+    { "llc_misses", PERF_TYPE_HW_CACHE, HW_CACHE_READ_MISS(LL) },
+    { "dtlb_misses", PERF_TYPE_HW_CACHE, HW_CACHE_READ_MISS(DTLB) },
+};
+
+#define NUM_PERF_COUNTERS (sizeof(perf_counters) / sizeof(perf_counters[0]))
+
+int perf_fds[NUM_PERF_COUNTERS];
+
+void perf_open(void) {
+    u32 num_open = 0;
+    for (u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        struct perf_event_attr attr = {
+            .type = perf_counters[i].type,
+            .size = sizeof(attr),
+            .config = perf_counters[i].config,
+            .disabled = 1,
+            .exclude_kernel = 1,
+            .exclude_hv = 1,
+            .read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING
+        };
+        perf_fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        num_open += perf_fds[i] >= 0;
+    }
+    if (num_open == 0) {
+        fprintf(stderr, "perf_event_open: %s; hardware counter columns are empty\n",
+            strerror(errno));
+    }
+}
+
+void perf_close(void) {
+    for (u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        if (perf_fds[i] >= 0) {
+            close(perf_fds[i]);
+        }
+    }
+}
+
+void perf_start(void) {
+    for (u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        if (perf_fds[i] >= 0) {
+            ioctl(perf_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+// Stop the counters and set counts[i] to the count of counter i,
+// or -1 if it is unavailable or never ran.
+void perf_stop(f64 *counts) {
+    for (u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        counts[i] = -1;
+        if (perf_fds[i] < 0) {
+            continue;
+        }
+        ioctl(perf_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        u64 value[3];
+        if (read(perf_fds[i], value, sizeof(value)) == sizeof(value) && value[2] > 0) {
+            counts[i] = (f64)value[0] * value[1] / value[2];
+        }
+    }
+}
+
+void print_per_sample(f64 count, u32 num_samples) {
+    if (count >= 0) {
+        printf(",%.4f", count / num_samples);
+    } else {
+        printf(",");
+    }
+}
+
+// One row of hardware counters and, with -DRR_COUNTERS, of events of the
+// recycled state, per sample of num_samples single sample_*_r calls.
+#ifdef RR_COUNTERS
+#define PRINT_RR_COUNTERS(s) \
+    printf(",%.4f,%.4f,%.4f,%.4f", \
+        (f64)(s)->counters.uniform_refills / num_samples, \
+        (f64)(s)->counters.uniform_retries / num_samples, \
+        (f64)(s)->counters.prediv_rejections / num_samples, \
+        (f64)(s)->counters.aldr_rejections / num_samples)
+#else
+#define PRINT_RR_COUNTERS(s) printf(",,,,")
+#endif
+
+#define PERF(key, \
+        struct_name, \
+        estimate, \
+        func_preprocess, \
+        func_sample, \
+        func_free) \
+    if (estimate <= max_bytes) { \
+        struct struct_name x = func_preprocess((void *)a, n); \
+        bench_state_init(s, 1); \
+        u32 sink = 0; \
+        f64 counts[NUM_PERF_COUNTERS]; \
+        f64 t0 = now(); \
+        perf_start(); \
+        for (u32 i = 0; i < num_samples; ++i) { \
+            sink += func_sample(s, &x); \
+        } \
+        perf_stop(counts); \
+        f64 t1 = now(); \
+        printf("%s,%lu,%s,%.3f", family, n, key, 1e9 * (t1 - t0) / num_samples); \
+        for (u32 i = 0; i < NUM_PERF_COUNTERS; ++i) { \
+            print_per_sample(counts[i], num_samples); \
+        } \
+        PRINT_RR_COUNTERS(s); \
+        printf("\n"); \
+        fflush(stdout); \
+        func_free(x); \
+        volatile u32 keep = sink; \
+        (void)keep; \
+    }
+
+void bench_perf(u32 max_n, u32 num_samples, u64 max_bytes) {
+    struct rr_state *s = malloc(sizeof(*s));
+    perf_open();
+    printf("family,n,sampler,ns_per_sample");
+    for (u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        printf(",%s", perf_counters[i].name);
+    }
+    printf(",refills,uniform_retries,prediv_rejections,aldr_rejections\n");
+    for (u32 f = 0; f < sizeof(families) / sizeof(families[0]); ++f) {
+        const char *family = families[f].name;
+        for (u64 n = 10; n <= max_n; n *= 10) {
+            u32 *a = malloc(n * sizeof(*a));
+            families[f].fill(a, n);
+            u64 m = 0;
+            for (u32 i = 0; i < n; ++i) {
+                m += a[i];
+            }
+            PERF("cdf", array_s, 4 * n,
+                preprocess_cdf, sample_cdf_eo_r, free_array)
+            PERF("lookup", lookup_eo_s, 4 * (n + 1) + m * index_width(n - 1),
+                preprocess_lookup_eo, sample_lookup_eo_r, free_lookup_eo)
+            PERF("alias", weighted_alias_eo_s, 28 * n,
+                preprocess_weighted_alias_eo, sample_weighted_alias_eo_r, free_weighted_alias_eo)
+            PERF("fldr", fldr_eo_s, 4 * (leaves_fldr(a, n) + n),
+                preprocess_fldr_eo, sample_fldr_eo_r, free_fldr_eo)
+            PERF("aldr", aldr_recycle_s, 4 * leaves_aldr(a, n, m) + 8 * n,
+                preprocess_aldr_recycle, sample_aldr_recycle_r, free_aldr_recycle)
+            free(a);
+        }
+    }
+    perf_close();
+    free(s);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+        printf("usage: %s [max_n] [num_samples] [max_table_bytes] [threads]\n", argv[0]);
+        printf("[max_n]            largest distribution size (default 100000000)\n");
+        printf("[num_samples]      samples per measurement (default 1000000)\n");
+        printf("[max_table_bytes]  skip tables larger than this (default 1073741824)\n");
+        printf("[threads]          threads for parallel preprocessing (default 0, every processor)\n\n");
+        printf("Prints one CSV row per family, size and sampler.\n\n");
+        printf("usage: %s shuffle [max_n]\n", argv[0]);
+        printf("[max_n]            largest array size (default 100000000)\n\n");
+        printf("Prints one CSV row per size and shuffle, for sizes 10^6, 10^7, ..., max_n.\n\n");
+        printf("usage: %s perf [max_n] [num_samples] [max_table_bytes]\n", argv[0]);
+        printf("[max_n]            largest distribution size (default 1000000)\n");
+        printf("[num_samples]      samples per measurement (default 1000000)\n");
+        printf("[max_table_bytes]  skip tables larger than this (default 1073741824)\n\n");
+        printf("Prints one CSV row per family, size and sampler, of hardware counters per\n");
+        printf("sample and, when built with -DRR_COUNTERS, events of the recycled state.\n");
+        exit(0);
+    }
+    if (argc > 1 && strcmp(argv[1], "shuffle") == 0) {
+        bench_shuffle(argc > 2 ? strtoull(argv[2], NULL, 10) : 100000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "perf") == 0) {
+        u32 num_samples = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000000;
+        bench_perf(argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000,
+            num_samples > 0 ? num_samples : 1,
+            argc > 4 ? strtoull(argv[4], NULL, 10) : (1ull << 30));
+        return 0;
+    }
+    u32 max_n = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000000;
+    u32 num_samples = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    u64 max_bytes = argc > 3 ? strtoull(argv[3], NULL, 10) : (1ull << 30);
+    u32 num_threads = argc > 4 ? strtoul(argv[4], NULL, 10) : 0;
+    if (num_samples == 0) num_samples = 1;
+
+    struct rr_state *s = malloc(sizeof(*s));
+    struct rr_lanes_s *l = malloc(sizeof(*l));
+    u32 *out = malloc(num_samples * sizeof(*out));
+
+    printf("family,n,sampler,preprocess_s,preprocess_parallel_s,table_bytes,ns_per_sample,"
+           "ns_per_sample_batch,bits_per_sample,entropy_bits\n");
+
+    u32 sizes[10] = { 2 };
+    u32 num_sizes = 1;
+    for (u64 n = 10; n <= max_n && num_sizes < 10; n *= 10) {
+        sizes[num_sizes++] = n;
+    }
+
+    for (u32 f = 0; f < sizeof(families) / sizeof(families[0]); ++f) {
+        const char *family = families[f].name;
+        for (u32 j = 0; j < num_sizes && sizes[j] <= max_n; ++j) {
+            u32 n = sizes[j];
+            u32 *a = malloc(n * sizeof(*a));
+            families[f].fill(a, n);
+            u64 m = 0;
+            for (u32 i = 0; i < n; ++i) {
+                m += a[i];
+            }
+            f64 h = entropy(a, n);
+
+            BENCH("cdf",
+                array_s,
+                4 * (u64)n,
+                preprocess_cdf,
+                BUILD_PARALLEL(array_s, preprocess_cdf_parallel, free_array),
+                sample_cdf_eo_r,
+                sample_cdf_eo_n_r,
+                bytes_array,
+                free_array)
+            BENCH("cdf_eytzinger",
+                cdf_eytzinger_s,
+                12 * ((u64)n + 1),
+                preprocess_cdf_eytzinger,
+                NO_BUILD_PARALLEL,
+                sample_cdf_eytzinger_eo_r,
+                sample_cdf_eytzinger_eo_n_r,
+                bytes_cdf_eytzinger,
+                free_cdf_eytzinger)
+            BENCH("lookup",
+                lookup_eo_s,
+                4 * ((u64)n + 1) + m * index_width(n - 1),
+                preprocess_lookup_eo,
+                BUILD_PARALLEL(lookup_eo_s, preprocess_lookup_eo_parallel, free_lookup_eo),
+                sample_lookup_eo_r,
+                sample_lookup_eo_n_r,
+                bytes_lookup_eo,
+                free_lookup_eo)
+            BENCH_LANES("lookup_lanes",
+                lookup_eo_s,
+                4 * ((u64)n + 1) + m * index_width(n - 1),
+                preprocess_lookup_eo,
+                BUILD_PARALLEL(lookup_eo_s, preprocess_lookup_eo_parallel, free_lookup_eo),
+                sample_lookup_eo_lanes,
+                bytes_lookup_eo,
+                free_lookup_eo)
+            BENCH("lookup_guide",
+                lookup_guide_s,
+                12 * ((u64)n + 1),
+                preprocess_lookup_guide_default,
+                NO_BUILD_PARALLEL,
+                sample_lookup_guide_eo_r,
+                sample_lookup_guide_eo_n_r,
+                bytes_lookup_guide,
+                free_lookup_guide)
+            BENCH("alias",
+                weighted_alias_eo_s,
+                28 * (u64)n,
+                preprocess_weighted_alias_eo,
+                BUILD_PARALLEL(weighted_alias_eo_s, preprocess_weighted_alias_eo_parallel, free_weighted_alias_eo),
+                sample_weighted_alias_eo_r,
+                sample_weighted_alias_eo_n_r,
+                bytes_weighted_alias_eo,
+                free_weighted_alias_eo)
+            BENCH_LANES("alias_lanes",
+                weighted_alias_s,
+                8 * (u64)n,
+                preprocess_weighted_alias,
+                NO_BUILD_PARALLEL,
+                sample_weighted_alias_recycle_lanes,
+                bytes_weighted_alias,
+                free_weighted_alias)
+            BENCH("fldr",
+                fldr_eo_s,
+                4 * (leaves_fldr(a, n) + n),
+                preprocess_fldr_eo,
+                BUILD_PARALLEL(fldr_eo_s, preprocess_fldr_eo_parallel, free_fldr_eo),
+                sample_fldr_eo_r,
+                sample_fldr_eo_n_r,
+                bytes_fldr_eo,
+                free_fldr_eo)
+            BENCH("fldr_accel",
+                fldr_eo_accel_s,
+                4 * (leaves_fldr(a, n) + n) + (8 << 12),
+                preprocess_fldr_eo_accel_default,
+                NO_BUILD_PARALLEL,
+                sample_fldr_eo_accel_r,
+                sample_fldr_eo_accel_n_r,
+                bytes_fldr_eo_accel,
+                free_fldr_eo_accel)
+            BENCH("aldr",
+                aldr_recycle_s,
+                4 * leaves_aldr(a, n, m) + 8 * (u64)n,
+                preprocess_aldr_recycle,
+                BUILD_PARALLEL(aldr_recycle_s, preprocess_aldr_recycle_parallel, free_aldr_recycle),
+                sample_aldr_recycle_r,
+                sample_aldr_recycle_n_r,
+                bytes_aldr_recycle,
+                free_aldr_recycle)
+            BENCH("aldr_accel",
+                aldr_recycle_accel_s,
+                4 * leaves_aldr(a, n, m) + 8 * (u64)n + (8 << 12),
+                preprocess_aldr_recycle_accel_default,
+                NO_BUILD_PARALLEL,
+                sample_aldr_recycle_accel_r,
+                sample_aldr_recycle_accel_n_r,
+                bytes_aldr_recycle_accel,
+                free_aldr_recycle_accel)
+
+            free(a);
+        }
+    }
+
+    free(out);
+    free(l);
+    free(s);
+
+    return 0;
+}
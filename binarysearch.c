@@ -7,23 +7,145 @@
   Released under Apache 2.0; refer to LICENSE.txt
 */
 
+#include <assert.h>
 #include <stdlib.h>
 
+#include "arena.h"
 #include "binarysearch.h"
+#include "parallel.h"
 #include "types.h"
 #include "uniform.h"
 
+// Parallel prefix sum: each thread sums its range, the range sums are
+// scanned in order, then each thread scans its range from its offset.
+// The arithmetic wraps exactly as in the serial sum.
+struct cdf_build_s {
+    const int *a;
+    u32 n;
+    u32 *sums;
+    u32 *cdf;
+};
+
+static void cdf_sum(void *p, u32 t, u32 num_threads) {
+    struct cdf_build_s *b = p;
+    u64 begin, end;
+    parallel_range(b->n, t, num_threads, &begin, &end);
+    u32 sum = 0;
+    for (u64 i = begin; i < end; ++i) {
+        sum += b->a[i];
+    }
+    b->sums[t] = sum;
+}
+
+static void cdf_scan(void *p, u32 t, u32 num_threads) {
+    struct cdf_build_s *b = p;
+    u64 begin, end;
+    parallel_range(b->n, t, num_threads, &begin, &end);
+    u32 sum = b->sums[t];
+    for (u64 i = begin; i < end; ++i) {
+        b->cdf[i + 1] = sum += b->a[i];
+    }
+}
+
+void fill_cdf(int* a, int n, u32 num_threads, u32 *cdf) {
+    num_threads = parallel_threads(num_threads, n);
+    cdf[0] = 0;
+    if (num_threads == 1) {
+        for (u32 i = 0; i < n; ++i) {
+            cdf[i + 1] = cdf[i] + a[i];
+        }
+        return;
+    }
+    struct cdf_build_s b = {
+        .a = a,
+        .n = n,
+        .sums = malloc(num_threads * sizeof(u32)),
+        .cdf = cdf
+    };
+    parallel_run(num_threads, cdf_sum, &b);
+    u32 offset = 0;
+    for (u32 t = 0; t < num_threads; ++t) {
+        u32 sum = b.sums[t];
+        b.sums[t] = offset;
+        offset += sum;
+    }
+    parallel_run(num_threads, cdf_scan, &b);
+    free(b.sums);
+}
+
 struct array_s preprocess_cdf(int* a, int n) {
-    struct array_s x = { .length = n+1, .a = malloc((n + 1) * sizeof(u32)) };
+    return preprocess_cdf_parallel(a, n, 1);
+}
+
+struct array_s preprocess_cdf_parallel(int* a, int n, u32 num_threads) {
+    struct array_s x = { .length = n+1 };
+    u64 bytes[] = { (u64)x.length * sizeof(x.a[0]) };
+    x.block = table_block_new(1, bytes, (void **)&x.a);
+    fill_cdf(a, n, num_threads, x.a);
+    x.modulus = uniform_modulus(x.a[n]);
+    return x;
+}
+
+static inline u32 sample_cdf_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct array_s *x) {
+    u32 uniform_index = uniform_eo_mod_local(s, state, bound, &x->modulus);
+    u32 low = 1;
+    u32 high = x->length - 1;
+    while (low < high) {
+        u32 mid = (low + high) / 2;
+        if (x->a[mid] <= uniform_index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    merge_state_local(state, bound, uniform_index - x->a[low-1], x->a[low] - x->a[low-1]);
+    return low - 1;
+}
+
+u32 sample_cdf_eo_r(struct rr_state *s, struct array_s *x) {
+    return sample_cdf_eo_local(s, &s->unif_state, &s->unif_bound, x);
+}
+
+u32 sample_cdf_eo(struct array_s *x) {
+    return sample_cdf_eo_r(&rr_default, x);
+}
+
+void sample_cdf_eo_n_r(struct rr_state *s, struct array_s *x, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_cdf_eo_r.
+    const struct array_s t = *x;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    for (u64 i = 0; i < count; ++i) {
+        out[i] = sample_cdf_eo_local(s, &state, &bound, &t);
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_cdf_eo_n(struct array_s *x, u32 *out, u64 count) {
+    sample_cdf_eo_n_r(&rr_default, x, out, count);
+}
+
+struct array64_s preprocess_cdf64(u64* a, u32 n) {
+    struct array64_s x = { .length = n+1 };
+    u64 bytes[] = { (u64)x.length * sizeof(x.a[0]) };
+    x.block = table_block_new(1, bytes, (void **)&x.a);
+    u128 sum = 0;
     x.a[0] = 0;
     for (u32 i = 0; i < n; ++i) {
+        sum += a[i];
+        assert(sum <= RR_MAX_RANGE);
         x.a[i + 1] = x.a[i] + a[i];
     }
+    x.modulus = uniform_modulus(x.a[n]);
     return x;
 }
 
-u32 sample_cdf_eo(struct array_s *x) {
-    u32 uniform_index = uniform_eo(x->a[x->length - 1]);
+static inline u32 sample_cdf64_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct array64_s *x) {
+    u64 uniform_index = uniform_eo_mod_local(s, state, bound, &x->modulus);
     u32 low = 1;
     u32 high = x->length - 1;
     while (low < high) {
@@ -34,6 +156,126 @@ u32 sample_cdf_eo(struct array_s *x) {
             high = mid;
         }
     }
-    merge_state(uniform_index - x->a[low-1], x->a[low] - x->a[low-1]);
+    merge_state_local(state, bound, uniform_index - x->a[low-1], x->a[low] - x->a[low-1]);
     return low - 1;
 }
+
+u32 sample_cdf64_eo_r(struct rr_state *s, struct array64_s *x) {
+    return sample_cdf64_eo_local(s, &s->unif_state, &s->unif_bound, x);
+}
+
+u32 sample_cdf64_eo(struct array64_s *x) {
+    return sample_cdf64_eo_r(&rr_default, x);
+}
+
+void sample_cdf64_eo_n_r(struct rr_state *s, struct array64_s *x, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_cdf64_eo_r.
+    const struct array64_s t = *x;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    for (u64 i = 0; i < count; ++i) {
+        out[i] = sample_cdf64_eo_local(s, &state, &bound, &t);
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_cdf64_eo_n(struct array64_s *x, u32 *out, u64 count) {
+    sample_cdf64_eo_n_r(&rr_default, x, out, count);
+}
+
+u32 eytzinger_fill(struct cdf_eytzinger_s *x, u32 *cdf, u32 i, u32 k) {
+    // In-order traversal of the implicit tree rooted at k
+    // assigns the sorted outcomes i, i+1, ... to its nodes.
+    if (k <= x->length) {
+        i = eytzinger_fill(x, cdf, i, 2 * k);
+        x->keys[k] = cdf[i + 1];
+        x->leaves[2 * k] = i;
+        x->leaves[2 * k + 1] = cdf[i];
+        ++i;
+        i = eytzinger_fill(x, cdf, i, 2 * k + 1);
+    }
+    return i;
+}
+
+struct cdf_eytzinger_s preprocess_cdf_eytzinger(int* a, int n) {
+    u32 *cdf = malloc((n + 1) * sizeof(u32));
+    fill_cdf(a, n, 1, cdf);
+    // The block aligns keys to cache lines, so that the 16 descendants
+    // keys[16k], ..., keys[16k+15] four levels down share one line.
+    struct cdf_eytzinger_s x = {
+        .length = n,
+        .total = cdf[n],
+        .modulus = uniform_modulus(cdf[n])
+    };
+    u64 bytes[] = {
+        (u64)(n + 1) * sizeof(x.keys[0]),
+        (u64)(2 * n + 2) * sizeof(x.leaves[0])
+    };
+    void *arrays[2];
+    x.block = table_block_new(2, bytes, arrays);
+    x.keys = arrays[0];
+    x.leaves = arrays[1];
+    x.keys[0] = 0;
+    x.leaves[0] = x.leaves[1] = 0;
+    eytzinger_fill(&x, cdf, 0, 1);
+    free(cdf);
+    return x;
+}
+
+static inline u32 sample_cdf_eytzinger_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct cdf_eytzinger_s *x) {
+    u32 uniform_index = uniform_eo_mod_local(s, state, bound, &x->modulus);
+    // Find the first key greater than uniform_index: descend by the
+    // comparison, then undo the right turns taken after the last left turn.
+    // The answer is on the path, so its leaf is prefetched along the way.
+    u32 k = 1;
+    while (k <= x->length) {
+        __builtin_prefetch(x->keys + 16 * k);
+        __builtin_prefetch(x->leaves + 2 * k);
+        k = 2 * k + (x->keys[k] <= uniform_index);
+    }
+    k >>= __builtin_ffs(~k);
+    u32 result = x->leaves[2 * k];
+    u32 lower = x->leaves[2 * k + 1];
+    merge_state_local(state, bound, uniform_index - lower, x->keys[k] - lower);
+    return result;
+}
+
+u32 sample_cdf_eytzinger_eo_r(struct rr_state *s, struct cdf_eytzinger_s *x) {
+    return sample_cdf_eytzinger_eo_local(s, &s->unif_state, &s->unif_bound, x);
+}
+
+u32 sample_cdf_eytzinger_eo(struct cdf_eytzinger_s *x) {
+    return sample_cdf_eytzinger_eo_r(&rr_default, x);
+}
+
+void sample_cdf_eytzinger_eo_n_r(struct rr_state *s, struct cdf_eytzinger_s *x, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_cdf_eytzinger_eo_r.
+    const struct cdf_eytzinger_s t = *x;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    for (u64 i = 0; i < count; ++i) {
+        out[i] = sample_cdf_eytzinger_eo_local(s, &state, &bound, &t);
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_cdf_eytzinger_eo_n(struct cdf_eytzinger_s *x, u32 *out, u64 count) {
+    sample_cdf_eytzinger_eo_n_r(&rr_default, x, out, count);
+}
+
+void free_cdf_eytzinger(struct cdf_eytzinger_s x) {
+    table_block_free(x.block);
+}
+
+u64 bytes_cdf_eytzinger(struct cdf_eytzinger_s *x) {
+    u64 bytes[] = {
+        (u64)(x->length + 1) * sizeof(x->keys[0]),
+        (u64)(2 * x->length + 2) * sizeof(x->leaves[0])
+    };
+    return sizeof(*x) + table_block_bytes(2, bytes);
+}
@@ -11,8 +11,45 @@
 #define BINARYSEARCH_H
 
 #include "types.h"
+#include "uniform.h"
+
+// Write the n + 1 prefix sums of a to cdf, on num_threads threads.
+void fill_cdf(int* a, int n, u32 num_threads, u32 *cdf);
 
 struct array_s preprocess_cdf(int* a, int n);
+// Same table, built on num_threads threads (0 for every processor).
+struct array_s preprocess_cdf_parallel(int* a, int n, u32 num_threads);
 u32 sample_cdf_eo(struct array_s *x);
+u32 sample_cdf_eo_r(struct rr_state *s, struct array_s *x);
+void sample_cdf_eo_n(struct array_s *x, u32 *out, u64 count);
+void sample_cdf_eo_n_r(struct rr_state *s, struct array_s *x, u32 *out, u64 count);
+
+// 64-bit weights, with total at most RR_MAX_RANGE.
+struct array64_s preprocess_cdf64(u64* a, u32 n);
+u32 sample_cdf64_eo(struct array64_s *x);
+u32 sample_cdf64_eo_r(struct rr_state *s, struct array64_s *x);
+void sample_cdf64_eo_n(struct array64_s *x, u32 *out, u64 count);
+void sample_cdf64_eo_n_r(struct rr_state *s, struct array64_s *x, u32 *out, u64 count);
+
+// CDF in Eytzinger (breadth-first) order, searched without branches.
+// keys[k] for k = 1, ..., length holds the upper end cdf[i+1] of an
+// outcome, and leaves[2k], leaves[2k+1] hold its index i and lower end
+// cdf[i], so the recycled residual needs a single extra access.
+struct cdf_eytzinger_s {
+    u32 length;
+    u32 total;
+    struct uniform_modulus_s modulus;   // of total
+    u32 *keys;
+    u32 *leaves;
+    void *block;
+};
+
+struct cdf_eytzinger_s preprocess_cdf_eytzinger(int* a, int n);
+u32 sample_cdf_eytzinger_eo(struct cdf_eytzinger_s *x);
+u32 sample_cdf_eytzinger_eo_r(struct rr_state *s, struct cdf_eytzinger_s *x);
+void sample_cdf_eytzinger_eo_n(struct cdf_eytzinger_s *x, u32 *out, u64 count);
+void sample_cdf_eytzinger_eo_n_r(struct rr_state *s, struct cdf_eytzinger_s *x, u32 *out, u64 count);
+void free_cdf_eytzinger(struct cdf_eytzinger_s x);
+u64 bytes_cdf_eytzinger(struct cdf_eytzinger_s *x);
 
 #endif
@@ -0,0 +1,516 @@
+/*
+  Name:     check.c
+  Purpose:  Checks of the samplers against reference samplers.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "source.h"
+#include "uniform.h"
+#include "binarysearch.h"
+#include "dynamic.h"
+#include "lookup.h"
+#include "serialize.h"
+#include "bank.h"
+#include "alias.h"
+#include "aldr.h"
+#include "counts.h"
+#include "shuffle.h"
+
+// Words replayed to a sampler and to its reference, so that samplers
+// that draw the same uniforms give the same samples and states.
+#define CHECK_WORDS (1u << 16)
+
+u64 check_words[CHECK_WORDS];
+
+void check_words_init(u64 seed) {
+    struct bit_source_s source = source_new_seeded(SOURCE_XOSHIRO256, seed);
+    source.fill(&source, check_words, CHECK_WORDS);
+}
+
+void check_state_init(struct rr_state *s) {
+    rr_state_init(s, source_replay(check_words, CHECK_WORDS));
+}
+
+bool check_same_state(struct rr_state *s, struct rr_state *t) {
+    return s->unif_state == t->unif_state && s->unif_bound == t->unif_bound;
+}
+
+// Weights below max_weight, a tenth of them 0, from a generator g.
+void check_weights(struct rr_state *g, u32 *a, u32 n, u32 max_weight) {
+    for (u32 i = 0; i < n; ++i) {
+        a[i] = uniform_eo_r(g, 10) == 0 ? 0 : uniform_eo_r(g, max_weight);
+    }
+    a[uniform_eo_r(g, n)] = 1 + uniform_eo_r(g, max_weight);
+}
+
+// Samples of a dynamic table after rounds of updates, insertions and
+// removals against samples of a cdf table of its current weights.
+bool check_dynamic(u32 num_samples) {
+    struct rr_state g;
+    rr_state_init(&g, source_new_seeded(SOURCE_XOSHIRO256, 1));
+    u32 n = 1000;
+    u32 capacity = 4 * n;
+    u32 *a = malloc(capacity * sizeof(u32));
+    u32 *out = malloc(num_samples * sizeof(u32));
+    check_weights(&g, a, n, 1000);
+    struct dynamic_s x = preprocess_dynamic(a, n);
+    bool ok = 1;
+    for (u32 round = 0; ok && round < 20; ++round) {
+        for (u32 op = 0; op < 100; ++op) {
+            u32 i = uniform_eo_r(&g, x.length);
+            bool is_free = (x.is_free[i / 64] >> (i % 64)) & 1;
+            u32 w = uniform_eo_r(&g, 1000);
+            switch (uniform_eo_r(&g, 3)) {
+            case 0:
+                if (!is_free) {
+                    update_weight_dynamic(&x, i, w);
+                    a[i] = w;
+                }
+                break;
+            case 1:
+                if (x.length < capacity || x.num_free > 0) {
+                    a[insert_dynamic(&x, w)] = w;
+                }
+                break;
+            default:
+                if (!is_free) {
+                    remove_dynamic(&x, i);
+                    a[i] = 0;
+                }
+                break;
+            }
+        }
+        if (x.total == 0) {
+            u32 i = insert_dynamic(&x, 1);
+            a[i] = 1;
+        }
+        struct array_s c = preprocess_cdf((int *)a, x.length);
+        struct rr_state s;
+        struct rr_state t;
+        check_state_init(&s);
+        check_state_init(&t);
+        sample_cdf_eo_n_r(&t, &c, out, num_samples);
+        for (u32 k = 0; ok && k < num_samples; ++k) {
+            ok = sample_dynamic_eo_r(&s, &x) == out[k];
+        }
+        ok = ok && check_same_state(&s, &t);
+        free_array(c);
+    }
+    free_dynamic(x);
+    free(a);
+    free(out);
+    return ok;
+}
+
+// Sizes of the tables compared with their references: the edges of
+// the tree layouts and some larger tables.
+const u32 check_sizes[] = { 1, 2, 3, 15, 16, 17, 1000, 100000 };
+
+// Samples of the eytzinger-ordered cdf against those of the sorted cdf.
+bool check_eytzinger(u32 num_samples) {
+    struct rr_state g;
+    rr_state_init(&g, source_new_seeded(SOURCE_XOSHIRO256, 2));
+    u32 *out = malloc(num_samples * sizeof(u32));
+    bool ok = 1;
+    for (u32 j = 0; ok && j < sizeof(check_sizes) / sizeof(check_sizes[0]); ++j) {
+        u32 n = check_sizes[j];
+        u32 *a = malloc(n * sizeof(u32));
+        check_weights(&g, a, n, 1u << 12);
+        struct array_s c = preprocess_cdf((int *)a, n);
+        struct cdf_eytzinger_s x = preprocess_cdf_eytzinger((int *)a, n);
+        struct rr_state s;
+        struct rr_state t;
+        check_state_init(&s);
+        check_state_init(&t);
+        sample_cdf_eo_n_r(&t, &c, out, num_samples);
+        for (u32 k = 0; ok && k < num_samples; ++k) {
+            ok = sample_cdf_eytzinger_eo_r(&s, &x) == out[k];
+        }
+        ok = ok && check_same_state(&s, &t);
+        free_cdf_eytzinger(x);
+        free_array(c);
+        free(a);
+    }
+    free(out);
+    return ok;
+}
+
+// Samples of guide tables with 1, 7 and the default number of buckets
+// against those of the full lookup table.
+bool check_guide(u32 num_samples) {
+    struct rr_state g;
+    rr_state_init(&g, source_new_seeded(SOURCE_XOSHIRO256, 3));
+    u32 *out = malloc(num_samples * sizeof(u32));
+    const u32 buckets[] = { 1, 7, 0 };
+    bool ok = 1;
+    for (u32 j = 0; ok && j < sizeof(check_sizes) / sizeof(check_sizes[0]); ++j) {
+        u32 n = check_sizes[j];
+        u32 *a = malloc(n * sizeof(u32));
+        check_weights(&g, a, n, 64);
+        struct lookup_eo_s l = preprocess_lookup_eo((int *)a, n);
+        for (u32 b = 0; ok && b < sizeof(buckets) / sizeof(buckets[0]); ++b) {
+            struct lookup_guide_s x = preprocess_lookup_guide(a, n, buckets[b]);
+            struct rr_state s;
+            struct rr_state t;
+            check_state_init(&s);
+            check_state_init(&t);
+            sample_lookup_eo_n_r(&t, &l, out, num_samples);
+            for (u32 k = 0; ok && k < num_samples; ++k) {
+                ok = sample_lookup_guide_eo_r(&s, &x) == out[k];
+            }
+            ok = ok && check_same_state(&s, &t);
+            free_lookup_guide(x);
+        }
+        free_lookup_eo(l);
+        free(a);
+    }
+    free(out);
+    return ok;
+}
+
+// File that check_serialize saves tables to and loads them back from.
+#define CHECK_TABLE_PATH "check_table.rr"
+
+// Defines check_round_trip_<name>, which saves a table of weights a to
+// CHECK_TABLE_PATH, loads it back, and compares samples and states of
+// the loaded table against those of the table it was saved from.
+#define CHECK_ROUND_TRIP(name, table_t, preprocess, sample_n_r, free_table)   \
+bool check_round_trip_##name(u32 *a, u32 n, u32 *out, u32 *loaded_out,       \
+        u32 num_samples) {                                                    \
+    table_t x = preprocess;                                                   \
+    table_t y;                                                                \
+    struct mapped_table_s m;                                                  \
+    bool ok = save_##name(CHECK_TABLE_PATH, &x)                               \
+        && load_##name(CHECK_TABLE_PATH, &y, &m);                             \
+    if (ok) {                                                                 \
+        struct rr_state s;                                                    \
+        struct rr_state t;                                                    \
+        check_state_init(&s);                                                 \
+        check_state_init(&t);                                                 \
+        sample_n_r(&s, &y, loaded_out, num_samples);                          \
+        sample_n_r(&t, &x, out, num_samples);                                 \
+        ok = memcmp(out, loaded_out, num_samples * sizeof(u32)) == 0          \
+            && check_same_state(&s, &t);                                      \
+        unmap_table(m);                                                       \
+    }                                                                         \
+    remove(CHECK_TABLE_PATH);                                                 \
+    free_table(x);                                                            \
+    return ok;                                                                \
+}
+
+CHECK_ROUND_TRIP(cdf, struct array_s, preprocess_cdf((int *)a, n),
+    sample_cdf_eo_n_r, free_array)
+CHECK_ROUND_TRIP(lookup_eo, struct lookup_eo_s, preprocess_lookup_eo((int *)a, n),
+    sample_lookup_eo_n_r, free_lookup_eo)
+CHECK_ROUND_TRIP(weighted_alias_eo, struct weighted_alias_eo_s,
+    preprocess_weighted_alias_eo((int *)a, n),
+    sample_weighted_alias_eo_n_r, free_weighted_alias_eo)
+CHECK_ROUND_TRIP(fldr_eo, struct fldr_eo_s, preprocess_fldr_eo(a, n),
+    sample_fldr_eo_n_r, free_fldr_eo)
+CHECK_ROUND_TRIP(aldr_recycle, struct aldr_recycle_s, preprocess_aldr_recycle(a, n),
+    sample_aldr_recycle_n_r, free_aldr_recycle)
+
+// Samples of each kind of table after a save and load against those of
+// the table it was saved from, and a load of the wrong kind, which must
+// be rejected.
+bool check_serialize(u32 num_samples) {
+    struct rr_state g;
+    rr_state_init(&g, source_new_seeded(SOURCE_XOSHIRO256, 4));
+    u32 *out = malloc(num_samples * sizeof(u32));
+    u32 *loaded_out = malloc(num_samples * sizeof(u32));
+    bool ok = 1;
+    for (u32 j = 0; ok && j < sizeof(check_sizes) / sizeof(check_sizes[0]); ++j) {
+        u32 n = check_sizes[j];
+        u32 *a = malloc(n * sizeof(u32));
+        check_weights(&g, a, n, 64);
+        ok = check_round_trip_cdf(a, n, out, loaded_out, num_samples)
+            && check_round_trip_lookup_eo(a, n, out, loaded_out, num_samples)
+            && check_round_trip_weighted_alias_eo(a, n, out, loaded_out, num_samples)
+            && check_round_trip_fldr_eo(a, n, out, loaded_out, num_samples)
+            && check_round_trip_aldr_recycle(a, n, out, loaded_out, num_samples);
+        if (ok) {
+            struct array_s x = preprocess_cdf((int *)a, n);
+            struct weighted_alias_eo_s y;
+            struct mapped_table_s m;
+            ok = save_cdf(CHECK_TABLE_PATH, &x)
+                && !load_weighted_alias_eo(CHECK_TABLE_PATH, &y, &m);
+            remove(CHECK_TABLE_PATH);
+            free_array(x);
+        }
+        free(a);
+    }
+    free(out);
+    free(loaded_out);
+    return ok;
+}
+
+// Samples of each row of a bank against those of a table of that row of
+// the kind the bank encoded it as, with rows of every kind, and the
+// records of a bank built on 4 threads against those built on one.
+bool check_bank(u32 num_samples) {
+    struct rr_state g;
+    rr_state_init(&g, source_new_seeded(SOURCE_XOSHIRO256, 5));
+    const u32 max_weights[] = { 4, 64, 1u << 12, 1u << 20 };
+    u32 num_rows = 300;
+    u64 *row_offsets = malloc((num_rows + 1) * sizeof(u64));
+    u32 *weights = malloc(num_rows * 64 * sizeof(u32));
+    row_offsets[0] = 0;
+    for (u32 id = 0; id < num_rows; ++id) {
+        u32 n = 1 + uniform_eo_r(&g, 64);
+        check_weights(&g, weights + row_offsets[id], n, max_weights[uniform_eo_r(&g, 4)]);
+        row_offsets[id + 1] = row_offsets[id] + n;
+    }
+    struct bank_s x = preprocess_bank(row_offsets, weights, num_rows);
+    struct bank_s y = preprocess_bank_parallel(row_offsets, weights, num_rows, 4);
+    bool ok = x.length_records == y.length_records
+        && memcmp(x.index, y.index, (num_rows + 1) * sizeof(u64)) == 0
+        && memcmp(x.records, y.records, x.length_records * sizeof(u32)) == 0;
+    u32 row_samples = num_samples / num_rows + 1;
+    u32 *out = malloc(row_samples * sizeof(u32));
+    u32 kinds[3] = { 0, 0, 0 };
+    for (u32 id = 0; ok && id < num_rows; ++id) {
+        u32 *a = weights + row_offsets[id];
+        u32 n = row_offsets[id + 1] - row_offsets[id];
+        struct rr_state s;
+        struct rr_state t;
+        check_state_init(&s);
+        check_state_init(&t);
+        enum bank_kind kind = bank_row_kind(&x, id);
+        kinds[kind]++;
+        if (kind == BANK_LOOKUP) {
+            struct lookup_eo_s l = preprocess_lookup_eo((int *)a, n);
+            sample_lookup_eo_n_r(&t, &l, out, row_samples);
+            free_lookup_eo(l);
+        } else if (kind == BANK_ALIAS) {
+            struct weighted_alias_eo_s l = preprocess_weighted_alias_eo((int *)a, n);
+            sample_weighted_alias_eo_n_r(&t, &l, out, row_samples);
+            free_weighted_alias_eo(l);
+        } else {
+            struct fldr_eo_s l = preprocess_fldr_eo(a, n);
+            sample_fldr_eo_n_r(&t, &l, out, row_samples);
+            free_fldr_eo(l);
+        }
+        for (u32 k = 0; ok && k < row_samples; ++k) {
+            ok = sample_bank_r(&s, &x, id) == out[k];
+        }
+        ok = ok && check_same_state(&s, &t);
+    }
+    ok = ok && kinds[BANK_LOOKUP] > 0 && kinds[BANK_ALIAS] > 0 && kinds[BANK_FLDR] > 0;
+    free_bank(x);
+    free_bank(y);
+    free(row_offsets);
+    free(weights);
+    free(out);
+    return ok;
+}
+
+enum check_variate_kind {
+    CHECK_BINOMIAL,
+    CHECK_GEOMETRIC,
+    CHECK_NEGATIVE_BINOMIAL,
+    CHECK_POISSON
+};
+
+// count is the number of trials of a binomial and the number of
+// successes of a negative binomial; p = numer/denom, or the mean of a
+// poisson.
+struct check_variate_s {
+    enum check_variate_kind kind;
+    u64 count;
+    u64 numer;
+    u64 denom;
+};
+
+const struct check_variate_s check_variates[] = {
+    { CHECK_BINOMIAL, 1000, 1, 2 },
+    { CHECK_BINOMIAL, 1ull << 40, 1, 2 },
+    { CHECK_BINOMIAL, 1000000000, 3, 7 },
+    { CHECK_BINOMIAL, 12345678901ull, 1, 1000 },
+    { CHECK_GEOMETRIC, 1, 1, 2 },
+    { CHECK_GEOMETRIC, 1, 1, 1000 },
+    { CHECK_NEGATIVE_BINOMIAL, 10, 1, 3 },
+    { CHECK_NEGATIVE_BINOMIAL, 1000, 1, 7 },
+    { CHECK_POISSON, 0, 3, 1 },
+    { CHECK_POISSON, 0, 23, 2 },
+    { CHECK_POISSON, 0, 1000000, 1 },
+    { CHECK_POISSON, 0, 123456789, 10 },
+};
+
+u64 check_variate_draw(struct rr_state *s, const struct check_variate_s *v) {
+    switch (v->kind) {
+    case CHECK_BINOMIAL:
+        return binomial_eo_r(s, v->count, v->numer, v->denom);
+    case CHECK_GEOMETRIC:
+        return geometric_eo_r(s, v->numer, v->denom);
+    case CHECK_NEGATIVE_BINOMIAL:
+        return negative_binomial_eo_r(s, v->count, v->numer, v->denom);
+    default:
+        return poisson_eo_r(s, v->numer, v->denom);
+    }
+}
+
+// Sample mean and variance of num_samples draws of each variate against
+// their exact values, each within 5 standard errors. The standard error
+// of the variance uses the sample fourth central moment.
+bool check_variates_moments(u32 num_samples) {
+    struct rr_state s;
+    rr_state_init(&s, source_new_seeded(SOURCE_XOSHIRO256, 6));
+    bool ok = 1;
+    for (u32 j = 0; j < sizeof(check_variates) / sizeof(check_variates[0]); ++j) {
+        const struct check_variate_s *v = &check_variates[j];
+        double p = (double)v->numer / v->denom;
+        double mean, variance;
+        switch (v->kind) {
+        case CHECK_BINOMIAL:
+            mean = v->count * p;
+            variance = v->count * p * (1 - p);
+            break;
+        case CHECK_GEOMETRIC:
+        case CHECK_NEGATIVE_BINOMIAL:
+            mean = v->count * (1 - p) / p;
+            variance = v->count * (1 - p) / (p * p);
+            break;
+        default:
+            mean = p;
+            variance = p;
+            break;
+        }
+        // Sums of powers of the deviations from the exact mean.
+        double d1 = 0, d2 = 0, d4 = 0;
+        for (u32 k = 0; k < num_samples; ++k) {
+            double d = (double)check_variate_draw(&s, v) - mean;
+            d1 += d;
+            d2 += d * d;
+            d4 += d * d * d * d;
+        }
+        double mean_error = d1 / num_samples;
+        double sample_variance = d2 / num_samples - mean_error * mean_error;
+        double fourth_moment = d4 / num_samples;
+        double z_mean = mean_error / sqrt(variance / num_samples);
+        double z_variance = (sample_variance - variance)
+            / sqrt((fourth_moment - variance * variance) / num_samples);
+        if (!(fabs(z_mean) < 5 && fabs(z_variance) < 5)) {
+            printf("variate %u: mean z %.2f, variance z %.2f\n", j, z_mean, z_variance);
+            ok = 0;
+        }
+    }
+    return ok;
+}
+
+// z-score of the chi-square statistic of counts of num_cells equally
+// likely cells, with df degrees of freedom.
+double check_chi_square_z(const u64 *counts, u32 num_cells, u64 total, u32 df) {
+    double expected = (double)total / num_cells;
+    double chi_square = 0;
+    for (u32 i = 0; i < num_cells; ++i) {
+        double d = counts[i] - expected;
+        chi_square += d * d / expected;
+    }
+    return (chi_square - df) / sqrt(2.0 * df);
+}
+
+// Index of the permutation p of 0, ..., n-1 among all n! of them.
+u32 check_permutation_rank(const u32 *p, u32 n) {
+    u32 rank = 0;
+    for (u32 i = 0; i < n; ++i) {
+        u32 smaller = 0;
+        for (u32 j = i + 1; j < n; ++j) {
+            smaller += p[j] < p[i];
+        }
+        rank = rank * (n - i) + smaller;
+    }
+    return rank;
+}
+
+// Frequencies of permutations from random_permutation_eo and shuffle_eo:
+// of each of the n! permutations for n up to 6, and of each value at
+// each position for n = 40, whose draws span several blocks of steps.
+// The chi-square statistics must be within 5 standard deviations of
+// their means.
+bool check_permutations(u32 num_samples) {
+    struct rr_state s;
+    rr_state_init(&s, source_new_seeded(SOURCE_XOSHIRO256, 7));
+    const u32 sizes[] = { 2, 3, 4, 5, 6, 40 };
+    bool ok = 1;
+    for (u32 shuffled = 0; shuffled < 2; ++shuffled) {
+        for (u32 j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j) {
+            u32 n = sizes[j];
+            u32 factorial = 1;
+            for (u32 i = 2; n <= 6 && i <= n; ++i) {
+                factorial *= i;
+            }
+            u32 num_cells = n <= 6 ? factorial : n * n;
+            u64 *counts = calloc(num_cells, sizeof(u64));
+            u32 p[40];
+            for (u32 k = 0; k < num_samples; ++k) {
+                if (shuffled) {
+                    for (u32 i = 0; i < n; ++i) {
+                        p[i] = i;
+                    }
+                    shuffle_eo_r(&s, p, n, sizeof(p[0]));
+                } else {
+                    random_permutation_eo_r(&s, p, n);
+                }
+                if (n <= 6) {
+                    counts[check_permutation_rank(p, n)]++;
+                } else {
+                    for (u32 i = 0; i < n; ++i) {
+                        counts[i * n + p[i]]++;
+                    }
+                }
+            }
+            double z = n <= 6
+                ? check_chi_square_z(counts, num_cells, num_samples, num_cells - 1)
+                : check_chi_square_z(counts, num_cells, (u64)num_samples * n, (n - 1) * (n - 1));
+            if (!(fabs(z) < 5)) {
+                printf("%s %u: chi-square z %.2f\n",
+                    shuffled ? "shuffle_eo" : "random_permutation_eo", n, z);
+                ok = 0;
+            }
+            free(counts);
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+        printf("usage: %s <check> [num_samples]\n", argv[0]);
+        printf("<check>          dynamic, eytzinger, guide, serialize, bank, variates,\n                 permutations\n");
+        printf("[num_samples]    samples per comparison (default 100000)\n\n");
+        printf("Prints the check and ok, or FAILED with exit status 1.\n");
+        exit(0);
+    }
+    u32 num_samples = argc > 2 ? strtoul(argv[2], NULL, 10) : 100000;
+    check_words_init(42);
+    bool ok;
+    if (strcmp(argv[1], "dynamic") == 0) {
+        ok = check_dynamic(num_samples);
+    } else if (strcmp(argv[1], "eytzinger") == 0) {
+        ok = check_eytzinger(num_samples);
+    } else if (strcmp(argv[1], "guide") == 0) {
+        ok = check_guide(num_samples);
+    } else if (strcmp(argv[1], "serialize") == 0) {
+        ok = check_serialize(num_samples);
+    } else if (strcmp(argv[1], "bank") == 0) {
+        ok = check_bank(num_samples);
+    } else if (strcmp(argv[1], "variates") == 0) {
+        ok = check_variates_moments(num_samples);
+    } else if (strcmp(argv[1], "permutations") == 0) {
+        ok = check_permutations(num_samples);
+    } else {
+        printf("unknown check: %s\n", argv[1]);
+        return 1;
+    }
+    printf("%s: %s\n", argv[1], ok ? "ok" : "FAILED");
+    return !ok;
+}
@@ -0,0 +1,651 @@
+/*
+  Name:     counts.c
+  Purpose:  Discrete variates and multinomial counts, with randomness recycling.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "counts.h"
+#include "types.h"
+#include "uniform.h"
+
+// Below this many trials, count the set bits of that many flips.
+#define BINOMIAL_DIRECT 32
+
+// Fixed point numbers with one integer word x[0] and fraction words
+// x[1], ..., x[words], most significant first.
+
+static void fixed_multiply(u64 *x, u32 words, u64 a) {
+    // The product must fit the integer word.
+    u128 carry = 0;
+    for (u32 i = words + 1; i-- > 0;) {
+        u128 product = (u128)x[i] * a + carry;
+        x[i] = product;
+        carry = product >> 64;
+    }
+}
+
+static void fixed_divide(u64 *x, u32 words, u64 a, bool up) {
+    // Rounds down, or up if up.
+    u128 remainder = 0;
+    for (u32 i = 0; i <= words; ++i) {
+        u128 dividend = remainder << 64 | x[i];
+        x[i] = dividend / a;
+        remainder = dividend % a;
+    }
+    for (u32 i = words + 1; up && remainder != 0 && i-- > 0;) {
+        remainder = ++x[i] == 0;
+    }
+}
+
+static void fixed_one(u64 *x, u32 words) {
+    x[0] = 1;
+    for (u32 i = 1; i <= words; ++i) {
+        x[i] = 0;
+    }
+}
+
+// Multiplies x by 4 while it is below 1/4, up to k times, so that a
+// product of ratios keeps its precision; returns the remaining k.
+static u64 fixed_scale(u64 *x, u32 words, u64 k) {
+    for (; k > 0 && x[0] == 0 && x[1] >> 62 == 0; --k) {
+        fixed_multiply(x, words, 4);
+    }
+    return k;
+}
+
+static int fixed_compare(const u64 *x, const u64 *y, u32 words) {
+    for (u32 i = 0; i <= words; ++i) {
+        if (x[i] != y[i]) {
+            return x[i] < y[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Sets x to a bound on a probability A in fixed point, rounded down,
+// or up if up.
+typedef void (*exact_bound_fn)(u64 *x, u32 words, bool up, const void *ctx);
+
+// Whether U < A, for U uniform on [0, 1) with leading 64 bits leading.
+// A is bounded with 2, 4, 8, ... fraction words until U falls outside
+// the bounds, drawing the bits of U that the bounds need; U is within
+// them with probability about their width, so few rounds are needed.
+static bool accept_exact_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        u64 leading, exact_bound_fn bound_fn, const void *ctx) {
+    u32 drawn = 1;
+    u64 *u = NULL;
+    u64 *low = NULL;
+    u64 *high = NULL;
+    bool accept;
+    for (u32 words = 2;; words *= 2) {
+        u = realloc(u, (words + 1) * sizeof(u64));
+        low = realloc(low, (words + 1) * sizeof(u64));
+        high = realloc(high, (words + 1) * sizeof(u64));
+        u[0] = 0;
+        u[1] = leading;
+        for (; drawn < words; ++drawn) {
+            u64 top = uniform_u32_from_unif_local(s, state, bound);
+            u[drawn + 1] = top << 32 | uniform_u32_from_unif_local(s, state, bound);
+        }
+        bound_fn(low, words, 0, ctx);
+        bound_fn(high, words, 1, ctx);
+        // U is in [u, u + 2^(-64 words)).
+        if (fixed_compare(u, high, words) >= 0) {
+            accept = 0;
+            break;
+        }
+        for (u32 i = words + 1; i-- > 0 && ++u[i] == 0;) {
+        }
+        if (fixed_compare(u, low, words) <= 0) {
+            accept = 1;
+            break;
+        }
+        for (u32 i = words + 1; i-- > 0 && u[i]-- == 0;) {
+        }
+    }
+    free(u);
+    free(low);
+    free(high);
+    return accept;
+}
+
+// Whether U < A, for U uniform on [0, 1), given bounds
+// exp(log_low) <= A <= exp(log_high): the first 32 or 64 bits of U
+// nearly always decide, and the values of U on the decided side are
+// merged back into the state. Otherwise accept_exact_local decides.
+static bool accept_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        f64 log_low, f64 log_high, exact_bound_fn bound_fn, const void *ctx) {
+    f64 low = exp(log_low);
+    f64 high = exp(log_high);
+    u64 leading = 0;
+    for (u32 i = 0; i < 2; ++i) {
+        // With the leading bits so far scaled to the integer u, the
+        // next 32 bits v decide when v < accept_below or v >= reject_from.
+        f64 u = leading;
+        f64 low_v = ldexp(ldexp(low, 32 * i) - u, 32);
+        f64 high_v = ldexp(ldexp(high, 32 * i) - u, 32);
+        u64 accept_below = low_v <= 0 ? 0 : low_v >= 0x1p32 ? 1ull << 32 : (u64)low_v;
+        u64 reject_from = high_v >= 0x1p32 ? 1ull << 32 : high_v < 0 ? 0 : (u64)high_v + 1;
+        u64 v = uniform_u32_from_unif_local(s, state, bound);
+        if (v < accept_below) {
+            merge_state_local(state, bound, v, accept_below);
+            return 1;
+        }
+        if (v >= reject_from) {
+            merge_state_local(state, bound, v - reject_from, (1ull << 32) - reject_from);
+            return 0;
+        }
+        leading = leading << 32 | v;
+    }
+    return accept_exact_local(s, state, bound, leading, bound_fn, ctx);
+}
+
+struct binomial_ratio_s {
+    u64 h;
+    u64 e;
+    u64 k;
+};
+
+// A = 4^k C(2h, h + e) / C(2h, h), the product of 4^k and the ratios
+// (h - t + 1) / (h + t) for t = 1, ..., e.
+static void binomial_ratio_bound(u64 *x, u32 words, bool up, const void *ctx) {
+    const struct binomial_ratio_s *r = ctx;
+    u64 k = r->k;
+    fixed_one(x, words);
+    for (u64 t = 1; t <= r->e; ++t) {
+        fixed_multiply(x, words, r->h - t + 1);
+        fixed_divide(x, words, r->h + t, up);
+        k = fixed_scale(x, words, k);
+    }
+    for (; k > 0; --k) {
+        fixed_multiply(x, words, 4);
+    }
+}
+
+// Bounds on ln(4^k C(2h, h + e) / C(2h, h)) for 0 < e <= h. Stirling's
+// series ln n! = n ln n - n + ln(2 pi n) / 2 + r(n), with
+// 1 / (12n + 1) < r(n) < 1 / (12n) for n >= 1 (Robbins 1955), gives
+//   -h g(e/h) - ln(1 - (e/h)^2) / 2 + 2 r(h) - r(h + e) - r(h - e)
+// for e < h, where g(t) = (1 + t) ln(1 + t) + (1 - t) ln(1 - t) is
+// the sum of t^(2i) / (i (2i - 1)) over i >= 1. The bounds are widened
+// by far more than the rounding error of the arithmetic.
+static void binomial_log_ratio(u64 h, u64 e, u64 k, f64 *log_low, f64 *log_high) {
+    f64 hf = h;
+    f64 sum;
+    f64 size;
+    f64 r_low = 2 / (12 * hf + 1);
+    f64 r_high = 2 / (12 * hf);
+    if (e == h) {
+        // ln((h!)^2 / (2h)!), where 0! = 1 has no series.
+        sum = -2 * hf * M_LN2 + log(M_PI * hf) / 2;
+        size = 2 * hf;
+        r_low -= 1 / (24 * hf);
+        r_high -= 1 / (24 * hf + 1);
+    } else {
+        f64 above = h + e;
+        f64 below = h - e;
+        f64 hg;
+        if (2 * e < h) {
+            f64 t = (f64)e / hf;
+            f64 series = 0;
+            f64 power = 1;
+            for (u64 i = 1;; ++i) {
+                f64 term = power / (f64)(i * (2 * i - 1));
+                series += term;
+                if (term < 0x1p-60 * series) {
+                    break;
+                }
+                power *= t * t;
+            }
+            hg = e * t * series;
+        } else {
+            hg = above * (log(above) - log(hf)) + below * (log(below) - log(hf));
+        }
+        sum = -hg - (log(above) + log(below) - 2 * log(hf)) / 2;
+        size = hg;
+        r_low -= 1 / (12 * above) + 1 / (12 * below);
+        r_high -= 1 / (12 * above + 1) + 1 / (12 * below + 1);
+    }
+    sum += 2 * M_LN2 * k;
+    f64 slack = 0x1p-40 * (size + k + 64);
+    *log_low = sum + r_low - slack;
+    *log_high = sum + r_high + slack;
+}
+
+static u64 binomial_half_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        u64 num_trials) {
+    // Output is distributed as binomial(num_trials, 1/2).
+    if (num_trials < BINOMIAL_DIRECT) {
+        return __builtin_popcountll(flip_n_from_unif_local(s, state, bound, num_trials));
+    }
+    u64 odd = num_trials & 1;
+    u64 h = num_trials >> 1;
+    // Propose h + d or h - d - 1, by a flip, for d = k*m + j with k
+    // geometric, P[k] = (3/4) 4^-k, and j uniform below m: the offset e
+    // from h has probability proportional to 4^-k. Keep it with
+    // probability A = 4^k C(2h, h + e) / C(2h, h), at most 1 for
+    // m^2 > 2h >= 22, as C(2h, h + e) / C(2h, h) <= exp(-e^2 / (h + e))
+    // (Bringmann et al. 2014). About half the proposals are kept, and
+    // A is decided from its bounds, so the expected cost is constant.
+    u64 m = sqrt(2 * (f64)h);
+    while (m * m <= 2 * h) {
+        ++m;
+    }
+    for (;;) {
+        u64 k = 0;
+        while (flip_n_from_unif_local(s, state, bound, 2) == 0) {
+            ++k;
+        }
+        u64 j = uniform_eo_local(s, state, bound, m);
+        u64 negative = flip_n_from_unif_local(s, state, bound, 1);
+        if (k > h / m) {
+            continue;
+        }
+        u64 e = k * m + j + negative;
+        if (e > h) {
+            continue;
+        }
+        if (e > 0) {
+            struct binomial_ratio_s r = { .h = h, .e = e, .k = k };
+            f64 log_low;
+            f64 log_high;
+            binomial_log_ratio(h, e, k, &log_low, &log_high);
+            if (!accept_local(s, state, bound, log_low, log_high, binomial_ratio_bound, &r)) {
+                continue;
+            }
+        }
+        u64 result = negative ? h - e : h + e;
+        return result + (odd ? flip_n_from_unif_local(s, state, bound, 1) : 0);
+    }
+}
+
+static u64 binomial_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        u64 num_trials, u64 numer, u64 denom) {
+    // Input 0 <= numer <= denom <= RR_MAX_RANGE.
+    if (numer == 0) {
+        return 0;
+    }
+    if (numer == denom) {
+        return num_trials;
+    }
+    if (num_trials < BINOMIAL_DIRECT) {
+        u64 successes = 0;
+        for (u64 i = 0; i < num_trials; ++i) {
+            successes += bernoulli_eo_local(s, state, bound, numer, denom);
+        }
+        return successes;
+    }
+    // Compare each trial's uniform with p = numer/denom one bit at a
+    // time: binomial(trials, 1/2) of the undecided trials have a 0 bit,
+    // and they succeed if p has a 1 bit there, or stay undecided if p
+    // has a 0 bit. About half the undecided trials are decided per bit,
+    // and none remain undecided once the bits of p are all 0.
+    u64 successes = 0;
+    u64 remainder = numer;
+    while (num_trials > 0 && remainder > 0) {
+        remainder <<= 1;
+        u64 zeros = binomial_half_local(s, state, bound, num_trials);
+        if (remainder >= denom) {
+            remainder -= denom;
+            successes += zeros;
+            num_trials -= zeros;
+        } else {
+            num_trials = zeros;
+        }
+    }
+    return successes;
+}
+
+u64 binomial_eo_r(struct rr_state *s, u64 num_trials, u64 numer, u64 denom) {
+    assert(numer <= denom);
+    assert(0 < denom && denom <= RR_MAX_RANGE);
+    assert(num_trials <= RR_MAX_RANGE);
+    return binomial_eo_local(s, &s->unif_state, &s->unif_bound, num_trials, numer, denom);
+}
+
+u64 binomial_eo(u64 num_trials, u64 numer, u64 denom) {
+    return binomial_eo_r(&rr_default, num_trials, numer, denom);
+}
+
+// Position of the j-th smallest element, for 1 <= j <= c, of a uniformly
+// random c-subset of [0, length). Halve the range, drawing how many of
+// the c elements fall in the lower half without replacement, and keep
+// the half that holds the j-th.
+static u64 subset_order_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        u64 length, u64 c, u64 j) {
+    u64 base = 0;
+    while (c < length) {
+        u64 half = length / 2;
+        u64 lower = 0;
+        for (u64 i = 0; i < c; ++i) {
+            lower += bernoulli_eo_local(s, state, bound, half - lower, length - i);
+        }
+        if (j <= lower) {
+            length = half;
+            c = lower;
+        } else {
+            base += half;
+            length -= half;
+            j -= lower;
+            c -= lower;
+        }
+    }
+    return base + j - 1;
+}
+
+static u64 negative_binomial_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        u64 num_successes, u64 numer, u64 denom) {
+    // Input 0 < numer <= denom <= RR_MAX_RANGE.
+    // Run the trials in blocks of length, the largest power of 2 with
+    // length * numer / denom <= num_successes / 2 for the successes
+    // still needed, and length <= RR_MAX_RANGE as binomial_eo requires,
+    // counting the successes of each block with binomial_eo. Each block
+    // takes about a quarter to a half of the successes needed, so there
+    // are O(log num_successes) blocks. In the block where the count
+    // reaches num_successes, the successes are a uniformly random subset
+    // of the block, so the last one needed is an order statistic of the
+    // subset.
+    if (num_successes == 0) {
+        return 0;
+    }
+    u64 length = 1;
+    while (length < RR_MAX_RANGE
+            && (u128)(length << 2) * numer <= (u128)num_successes * denom) {
+        length <<= 1;
+    }
+    u64 failures = 0;
+    for (;;) {
+        while (length > 1 && (u128)(length << 1) * numer > (u128)num_successes * denom) {
+            length >>= 1;
+        }
+        u64 successes = binomial_eo_local(s, state, bound, length, numer, denom);
+        if (successes < num_successes) {
+            failures += length - successes;
+            num_successes -= successes;
+            continue;
+        }
+        u64 position = subset_order_local(s, state, bound, length, successes, num_successes);
+        return failures + position - (num_successes - 1);
+    }
+}
+
+u64 negative_binomial_eo_r(struct rr_state *s, u64 num_successes, u64 numer, u64 denom) {
+    assert(0 < numer && numer <= denom);
+    assert(denom <= RR_MAX_RANGE);
+    return negative_binomial_eo_local(s, &s->unif_state, &s->unif_bound, num_successes, numer, denom);
+}
+
+u64 negative_binomial_eo(u64 num_successes, u64 numer, u64 denom) {
+    return negative_binomial_eo_r(&rr_default, num_successes, numer, denom);
+}
+
+u64 geometric_eo_r(struct rr_state *s, u64 numer, u64 denom) {
+    return negative_binomial_eo_r(s, 1, numer, denom);
+}
+
+u64 geometric_eo(u64 numer, u64 denom) {
+    return geometric_eo_r(&rr_default, numer, denom);
+}
+
+static u64 poisson_small_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        u64 numer, u64 denom) {
+    // Input 2 * numer <= denom, for a mean l = numer/denom <= 1/2.
+    // Von Neumann's method: propose n with probability (1 - l) l^n, and
+    // keep it when each of n uniforms is larger than those before it,
+    // with probability 1/n!, so that n is kept with probability
+    // proportional to l^n / n!. The i-th uniform is the largest so far
+    // with probability 1/i, independently of the others.
+    for (;;) {
+        u64 n = 0;
+        while (bernoulli_eo_local(s, state, bound, numer, denom)) {
+            ++n;
+        }
+        u64 i = 2;
+        while (i <= n && bernoulli_eo_local(s, state, bound, 1, i)) {
+            ++i;
+        }
+        if (i > n) {
+            return n;
+        }
+    }
+}
+
+// Below this mean, poisson_eo sums von Neumann draws.
+#define POISSON_DIRECT 16
+
+struct poisson_ratio_s {
+    u64 numer;
+    u64 denom;
+    u64 mode;
+    u64 e;
+    u64 k;
+    bool negative;
+};
+
+// A = 4^k P[mode + e] / P[mode] for poisson(numer/denom), the product of
+// 4^k and the ratios numer / (denom (mode + t)) for t = 1, ..., e; or
+// with mode - e, of the ratios (mode - t) denom / numer for
+// t = 0, ..., e - 1.
+static void poisson_ratio_bound(u64 *x, u32 words, bool up, const void *ctx) {
+    const struct poisson_ratio_s *r = ctx;
+    u64 k = r->k;
+    fixed_one(x, words);
+    for (u64 t = 0; t < r->e; ++t) {
+        if (r->negative) {
+            fixed_multiply(x, words, r->mode - t);
+            fixed_divide(x, words, r->numer, up);
+            fixed_multiply(x, words, r->denom);
+        } else {
+            fixed_multiply(x, words, r->numer);
+            fixed_divide(x, words, r->denom, up);
+            fixed_divide(x, words, r->mode + t + 1, up);
+        }
+        k = fixed_scale(x, words, k);
+    }
+    for (; k > 0; --k) {
+        fixed_multiply(x, words, 4);
+    }
+}
+
+// Bounds on ln A for poisson_ratio_bound, for e > 0, with mean l, mode
+// M = floor(l) and t = e/M, by Stirling's series as in
+// binomial_log_ratio:
+//   above M: -e ln((M + e) / l) + M (t - ln(1 + t)) - ln(1 + t) / 2
+//            + r(M) - r(M + e),
+//   below M: -e ln(l / M) - M ((1 - t) ln(1 - t) + t) - ln(1 - t) / 2
+//            + r(M) - r(M - e) for e < M,
+//   at 0:    -M ln(l / M) - M + ln(2 pi M) / 2 + r(M).
+static void poisson_log_ratio(const struct poisson_ratio_s *r, f64 *log_low, f64 *log_high) {
+    f64 mode = r->mode;
+    f64 e = r->e;
+    f64 t = e / mode;
+    // The mean is mode + remainder / denom.
+    u64 remainder = r->numer - r->mode * r->denom;
+    f64 sum;
+    f64 size;
+    f64 r_low = 1 / (12 * mode + 1);
+    f64 r_high = 1 / (12 * mode);
+    if (!r->negative) {
+        f64 above = r->mode + r->e;
+        // M (t - ln(1 + t)).
+        f64 mt;
+        if (2 * r->e < r->mode) {
+            f64 series = 0;
+            f64 power = 1;
+            for (u64 i = 2;; ++i) {
+                f64 term = power / (f64)i;
+                series += term;
+                if (fabs(term) < 0x1p-60 * series) {
+                    break;
+                }
+                power *= -t;
+            }
+            mt = e * t * series;
+        } else {
+            mt = e - mode * (log(above) - log(mode));
+        }
+        f64 excess = (u128)r->e * r->denom - remainder;
+        f64 ln_ratio = e * log1p(excess / (f64)r->numer);
+        sum = -ln_ratio + mt - (log(above) - log(mode)) / 2;
+        size = ln_ratio + mt;
+        r_low -= 1 / (12 * above);
+        r_high -= 1 / (12 * above + 1);
+    } else if (r->e < r->mode) {
+        f64 below = r->mode - r->e;
+        // M ((1 - t) ln(1 - t) + t).
+        f64 mt;
+        if (2 * r->e < r->mode) {
+            f64 series = 0;
+            f64 power = 1;
+            for (u64 i = 2;; ++i) {
+                f64 term = power / (f64)(i * (i - 1));
+                series += term;
+                if (term < 0x1p-60 * series) {
+                    break;
+                }
+                power *= t;
+            }
+            mt = e * t * series;
+        } else {
+            mt = below * (log(below) - log(mode)) + e;
+        }
+        f64 ln_ratio = e * log1p(remainder / (mode * r->denom));
+        sum = -ln_ratio - mt - (log(below) - log(mode)) / 2;
+        size = ln_ratio + mt;
+        r_low -= 1 / (12 * below);
+        r_high -= 1 / (12 * below + 1);
+    } else {
+        f64 ln_ratio = mode * log1p(remainder / (mode * r->denom));
+        sum = -ln_ratio - mode + log(2 * M_PI * mode) / 2;
+        size = ln_ratio + mode;
+    }
+    sum += 2 * M_LN2 * r->k;
+    f64 slack = 0x1p-40 * (size + r->k + 64);
+    *log_low = sum + r_low - slack;
+    *log_high = sum + r_high + slack;
+}
+
+static u64 poisson_large_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        u64 numer, u64 denom) {
+    // Input numer / denom >= POISSON_DIRECT.
+    // As in binomial_half_local, propose mode + d or mode - d - 1 for
+    // d = k*m + j, and keep the offset e with probability
+    // A = 4^k P[mode + e] / P[mode], at most 1 for m^2 - 4.77m >= 2.77M:
+    // P[M + e] / P[M] <= exp(-e (e - 1) / (2 (M + e))) above the mode
+    // and exp(-e (e - 1) / (2M)) below it.
+    u64 mode = numer / denom;
+    u64 m = (u64)sqrt(3 * (f64)mode) + 5;
+    for (;;) {
+        u64 k = 0;
+        while (flip_n_from_unif_local(s, state, bound, 2) == 0) {
+            ++k;
+        }
+        u64 j = uniform_eo_local(s, state, bound, m);
+        bool negative = flip_n_from_unif_local(s, state, bound, 1);
+        if (k > (UINT64_MAX - mode) / m - 1) {
+            // Past UINT64_MAX, which no result reaches in practice.
+            continue;
+        }
+        u64 e = k * m + j + negative;
+        if (negative && e > mode) {
+            continue;
+        }
+        if (e > 0) {
+            struct poisson_ratio_s r = {
+                .numer = numer, .denom = denom, .mode = mode,
+                .e = e, .k = k, .negative = negative
+            };
+            f64 log_low;
+            f64 log_high;
+            poisson_log_ratio(&r, &log_low, &log_high);
+            if (!accept_local(s, state, bound, log_low, log_high, poisson_ratio_bound, &r)) {
+                continue;
+            }
+        }
+        return negative ? mode - e : mode + e;
+    }
+}
+
+u64 poisson_eo_r(struct rr_state *s, u64 numer, u64 denom) {
+    assert(0 < denom);
+    if (numer == 0) {
+        return 0;
+    }
+    // Sum poisson(numer / (denom * parts)) over parts with means at most 1/2.
+    u64 parts = (2 * (u128)numer + denom - 1) / denom;
+    assert((u128)denom * parts <= RR_MAX_RANGE);
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    u64 result = 0;
+    if (numer / denom >= POISSON_DIRECT) {
+        result = poisson_large_local(s, &state, &bound, numer, denom);
+    } else {
+        for (u64 i = 0; i < parts; ++i) {
+            result += poisson_small_local(s, &state, &bound, numer, denom * parts);
+        }
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+    return result;
+}
+
+u64 poisson_eo(u64 numer, u64 denom) {
+    return poisson_eo_r(&rr_default, numer, denom);
+}
+
+static inline u64 counts_cdf(const u32 *cdf32, const u64 *cdf64, u32 i) {
+    return cdf64 ? cdf64[i] : cdf32[i];
+}
+
+static void counts_split_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const u32 *cdf32, const u64 *cdf64, u32 low, u32 high, u64 num_samples, u64 *counts) {
+    // Split the num_samples samples in outcomes [low, high) between the
+    // halves [low, mid) and [mid, high) by their weights.
+    while (high - low > 1) {
+        u32 mid = low + (high - low) / 2;
+        u64 weight_low = counts_cdf(cdf32, cdf64, low);
+        u64 left = num_samples == 0 ? 0 : binomial_eo_local(s, state, bound, num_samples,
+            counts_cdf(cdf32, cdf64, mid) - weight_low,
+            counts_cdf(cdf32, cdf64, high) - weight_low);
+        counts_split_local(s, state, bound, cdf32, cdf64, low, mid, left, counts);
+        low = mid;
+        num_samples -= left;
+    }
+    counts[low] = num_samples;
+}
+
+void sample_counts_r(struct rr_state *s, struct array_s *x, u64 num_samples, u64 *counts) {
+    assert(x->a[x->length - 1] > 0);
+    assert(num_samples <= RR_MAX_RANGE);
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    counts_split_local(s, &state, &bound, x->a, NULL, 0, x->length - 1, num_samples, counts);
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_counts(struct array_s *x, u64 num_samples, u64 *counts) {
+    sample_counts_r(&rr_default, x, num_samples, counts);
+}
+
+void sample_counts64_r(struct rr_state *s, struct array64_s *x, u64 num_samples, u64 *counts) {
+    assert(x->a[x->length - 1] > 0);
+    assert(num_samples <= RR_MAX_RANGE);
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    counts_split_local(s, &state, &bound, NULL, x->a, 0, x->length - 1, num_samples, counts);
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_counts64(struct array64_s *x, u64 num_samples, u64 *counts) {
+    sample_counts64_r(&rr_default, x, num_samples, counts);
+}
@@ -0,0 +1,57 @@
+/*
+  Name:     counts.h
+  Purpose:  Discrete variates and multinomial counts, with randomness recycling.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#ifndef COUNTS_H
+#define COUNTS_H
+
+#include "types.h"
+#include "uniform.h"
+
+// Number of successes in num_trials independent bernoulli(numer/denom)
+// trials, for 0 <= numer <= denom <= RR_MAX_RANGE and
+// num_trials <= RR_MAX_RANGE. Each bit of numer/denom takes one
+// binomial(k, 1/2) draw of constant expected cost, and decides about
+// half of the k undecided trials, so the expected cost grows with the
+// logarithm of num_trials.
+u64 binomial_eo_r(struct rr_state *s, u64 num_trials, u64 numer, u64 denom);
+u64 binomial_eo(u64 num_trials, u64 numer, u64 denom);
+
+// Number of failures before the num_successes-th success in independent
+// bernoulli(numer/denom) trials, for 0 < numer <= denom <= RR_MAX_RANGE.
+// The trials are counted in blocks by binomial_eo, each block taking
+// about a quarter to a half of the successes still needed, so the
+// expected cost grows with log(num_successes) log(num_successes * denom
+// / numer) while the blocks stay below RR_MAX_RANGE.
+u64 negative_binomial_eo_r(struct rr_state *s, u64 num_successes, u64 numer, u64 denom);
+u64 negative_binomial_eo(u64 num_successes, u64 numer, u64 denom);
+
+// Number of failures before the first success, as above, in expected
+// time O(log(denom / numer)).
+u64 geometric_eo_r(struct rr_state *s, u64 numer, u64 denom);
+u64 geometric_eo(u64 numer, u64 denom);
+
+// Poisson with mean numer/denom, for 0 < denom and
+// denom * ceil(2 * numer / denom) <= RR_MAX_RANGE. Means below 16 sum
+// von Neumann draws, in time linear in the mean; larger means are drawn
+// by rejection around the mode, in constant expected time.
+u64 poisson_eo_r(struct rr_state *s, u64 numer, u64 denom);
+u64 poisson_eo(u64 numer, u64 denom);
+
+// Counts of each outcome in num_samples samples from the distribution
+// of the table x of preprocess_cdf, without drawing the samples:
+// counts[0], ..., counts[n-1] are exactly multinomial, in expected
+// time O(n log num_samples).
+void sample_counts_r(struct rr_state *s, struct array_s *x, u64 num_samples, u64 *counts);
+void sample_counts(struct array_s *x, u64 num_samples, u64 *counts);
+
+// The same from the table of preprocess_cdf64.
+void sample_counts64_r(struct rr_state *s, struct array64_s *x, u64 num_samples, u64 *counts);
+void sample_counts64(struct array64_s *x, u64 num_samples, u64 *counts);
+
+#endif
@@ -0,0 +1,157 @@
+/*
+  Name:     dynamic.c
+  Purpose:  Sampling from distributions with changing weights.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dynamic.h"
+#include "types.h"
+#include "uniform.h"
+
+// The tree is 1-indexed: tree[j] holds the sum of the weights of slots
+// j - (j & -j), ..., j - 1. The capacity is a power of two, so that
+// tree[capacity] is the total and the search can halve its step.
+// Bit i of is_free is set while slot i is on the free list.
+
+static u64 free_words(u32 capacity) {
+    return (capacity + 63) / 64;
+}
+
+static bool slot_is_free(const struct dynamic_s *x, u32 i) {
+    return (x->is_free[i / 64] >> (i % 64)) & 1;
+}
+
+struct dynamic_s preprocess_dynamic(u32* a, u32 n) {
+    u32 capacity = 1;
+    while (capacity < n) {
+        capacity <<= 1;
+    }
+    struct dynamic_s x = {
+        .length = n,
+        .capacity = capacity,
+        .num_free = 0,
+        .total = 0,
+        .tree = calloc(capacity + 1, sizeof(u64)),
+        .weights = calloc(capacity, sizeof(u64)),
+        .free_slots = NULL,
+        .is_free = calloc(free_words(capacity), sizeof(u64))
+    };
+    for (u32 i = 0; i < n; ++i) {
+        x.weights[i] = a[i];
+        x.tree[i + 1] = a[i];
+        x.total += a[i];
+    }
+    assert(x.total <= RR_MAX_RANGE);
+    x.modulus = uniform_modulus(x.total);
+    // Build all partial sums in O(n) by pushing each node to its parent.
+    for (u32 j = 1; j <= capacity; ++j) {
+        u32 parent = j + (j & -j);
+        if (parent <= capacity) {
+            x.tree[parent] += x.tree[j];
+        }
+    }
+    return x;
+}
+
+void update_weight_dynamic(struct dynamic_s *x, u32 i, u64 w) {
+    assert(i < x->length && !slot_is_free(x, i));
+    // Unsigned wraparound makes a negative delta work.
+    u64 delta = w - x->weights[i];
+    x->weights[i] = w;
+    x->total += delta;
+    assert(x->total <= RR_MAX_RANGE);
+    x->modulus = uniform_modulus(x->total);
+    for (u32 j = i + 1; j <= x->capacity; j += j & -j) {
+        x->tree[j] += delta;
+    }
+}
+
+static void grow_dynamic(struct dynamic_s *x) {
+    // Doubling keeps every existing node; of the new nodes, only
+    // tree[2 * capacity] covers existing slots, and it holds the total.
+    u32 capacity = x->capacity << 1;
+    x->tree = realloc(x->tree, (capacity + 1) * sizeof(u64));
+    x->weights = realloc(x->weights, capacity * sizeof(u64));
+    memset(x->tree + x->capacity + 1, 0, x->capacity * sizeof(u64));
+    memset(x->weights + x->capacity, 0, x->capacity * sizeof(u64));
+    u64 words = free_words(x->capacity);
+    x->is_free = realloc(x->is_free, free_words(capacity) * sizeof(u64));
+    memset(x->is_free + words, 0, (free_words(capacity) - words) * sizeof(u64));
+    x->tree[capacity] = x->total;
+    x->capacity = capacity;
+}
+
+u32 insert_dynamic(struct dynamic_s *x, u64 w) {
+    u32 i;
+    if (x->num_free > 0) {
+        i = x->free_slots[--x->num_free];
+        x->is_free[i / 64] &= ~(1ull << (i % 64));
+    } else {
+        if (x->length == x->capacity) {
+            grow_dynamic(x);
+        }
+        i = x->length++;
+    }
+    update_weight_dynamic(x, i, w);
+    return i;
+}
+
+void remove_dynamic(struct dynamic_s *x, u32 i) {
+    // update_weight_dynamic also rejects a slot that is already free.
+    update_weight_dynamic(x, i, 0);
+    x->is_free[i / 64] |= 1ull << (i % 64);
+    // The free list never holds more than length slots.
+    if ((x->num_free & (x->num_free - 1)) == 0) {
+        u32 size = x->num_free == 0 ? 1 : 2 * x->num_free;
+        x->free_slots = realloc(x->free_slots, size * sizeof(u32));
+    }
+    x->free_slots[x->num_free++] = i;
+}
+
+u32 sample_dynamic_eo_r(struct rr_state *s, struct dynamic_s *x) {
+    // Inversion sampling: find the slot i with
+    // cdf[i] <= uniform_index < cdf[i+1] by descending the tree,
+    // then recycle uniform_index - cdf[i] ~ unif[0, weights[i]).
+    assert(x->total > 0);
+    u64 uniform_index = uniform_eo_mod_r(s, &x->modulus);
+    u32 pos = 0;
+    for (u32 step = x->capacity >> 1; step > 0; step >>= 1) {
+        u64 t = x->tree[pos + step];
+        if (t <= uniform_index) {
+            pos += step;
+            uniform_index -= t;
+        }
+    }
+    merge_state_r(s, uniform_index, x->weights[pos]);
+    return pos;
+}
+
+u32 sample_dynamic_eo(struct dynamic_s *x) {
+    return sample_dynamic_eo_r(&rr_default, x);
+}
+
+void free_dynamic(struct dynamic_s x) {
+    free(x.tree);
+    free(x.weights);
+    free(x.free_slots);
+    free(x.is_free);
+}
+
+u64 bytes_dynamic(struct dynamic_s *x) {
+    return sizeof(x->length)
+        + sizeof(x->capacity)
+        + sizeof(x->num_free)
+        + sizeof(x->total)
+        + sizeof(x->modulus)
+        + (x->capacity + 1) * sizeof(x->tree[0])
+        + x->capacity * sizeof(x->weights[0])
+        + x->num_free * sizeof(x->free_slots[0])
+        + free_words(x->capacity) * sizeof(x->is_free[0]);
+}
@@ -0,0 +1,46 @@
+/*
+  Name:     dynamic.h
+  Purpose:  Sampling from distributions with changing weights.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#ifndef DYNAMIC_H
+#define DYNAMIC_H
+
+#include "types.h"
+#include "uniform.h"
+
+// Fenwick tree over the weights, so that the CDF used by inversion
+// sampling can be searched and updated in O(log n).
+// Outcomes are slots 0, ..., length-1; removed slots have weight 0
+// and are reused by later insertions.
+// The total weight must stay at most RR_MAX_RANGE and be positive when
+// sampling; updating or removing a removed slot is an error. These are
+// checked with assert.
+struct dynamic_s {
+    u32 length;
+    u32 capacity;
+    u32 num_free;
+    u64 total;
+    // Of the total, kept current by every update so that sampling
+    // only reads the structure.
+    struct uniform_modulus_s modulus;
+    u64 *tree;
+    u64 *weights;
+    u32 *free_slots;
+    u64 *is_free;
+};
+
+struct dynamic_s preprocess_dynamic(u32* a, u32 n);
+void update_weight_dynamic(struct dynamic_s *x, u32 i, u64 w);
+u32 insert_dynamic(struct dynamic_s *x, u64 w);
+void remove_dynamic(struct dynamic_s *x, u32 i);
+u32 sample_dynamic_eo(struct dynamic_s *x);
+u32 sample_dynamic_eo_r(struct rr_state *s, struct dynamic_s *x);
+void free_dynamic(struct dynamic_s x);
+u64 bytes_dynamic(struct dynamic_s *x);
+
+#endif
@@ -0,0 +1,259 @@
+/*
+  Name:     gen.c
+  Purpose:  Generating specialized samplers for fixed distributions.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "uniform.h"
+#include "aldr.h"
+
+// The DDG tree walk of sample_fldr_eo and sample_aldr_recycle stops at
+// the first depth d with a leaf for the top d bits of flips. That is
+// the first level with flips < threshold[d], where the thresholds only
+// depend on the breadths, and the leaf is then
+// leaves_flat[(flips >> (K - d)) - offset[d]]. The generated sampler
+// finds d by comparing flips with the thresholds of the nonempty
+// levels, without branches, and reads the leaf and its weight from
+// static tables; the recycled state is the same as in the walk.
+struct levels_s {
+    u32 num_levels;     // nonempty levels
+    u32 *shift;         // K - d
+    u64 *threshold;
+    u64 *offset;
+};
+
+static struct levels_s compute_levels(const u32 *breadths, u32 length_breadths) {
+    u32 num_flips = length_breadths - 1;
+    struct levels_s x = {
+        .shift = malloc(length_breadths * sizeof(u32)),
+        .threshold = malloc(length_breadths * sizeof(u64)),
+        .offset = malloc(length_breadths * sizeof(u64))
+    };
+    u64 before = 0;     // value of the top d bits below which the walk stopped
+    u64 location = 0;
+    for (u32 d = 0; d < length_breadths; ++d) {
+        if (breadths[d] > 0) {
+            x.shift[x.num_levels] = num_flips - d;
+            x.threshold[x.num_levels] = (before + breadths[d]) << (num_flips - d);
+            x.offset[x.num_levels] = before - location;
+            ++x.num_levels;
+        }
+        before = (before + breadths[d]) << 1;
+        location += breadths[d];
+    }
+    return x;
+}
+
+static void free_levels(struct levels_s x) {
+    free(x.shift);
+    free(x.threshold);
+    free(x.offset);
+}
+
+static void print_u32s(const char *type, const char *name, const char *suffix,
+        const u32 *a, u64 length) {
+    printf("static const %s %s_%s[%lu] = {", type, name, suffix, length);
+    for (u64 i = 0; i < length; ++i) {
+        printf("%s%u,", i % 8 ? " " : "\n    ", a[i]);
+    }
+    printf("\n};\n\n");
+}
+
+static void print_u64s(const char *name, const char *suffix, const u64 *a, u64 length) {
+    printf("static const u64 %s_%s[%lu] = {", name, suffix, length);
+    for (u64 i = 0; i < length; ++i) {
+        printf("%s%luull,", i % 4 ? " " : "\n    ", a[i]);
+    }
+    printf("\n};\n\n");
+}
+
+static const char *index_type(u32 width) {
+    return width == 1 ? "u8" : width == 2 ? "u16" : "u32";
+}
+
+static void print_tables(const char *name, struct levels_s *v,
+        const u32 *leaves, u32 leaves_width, const u64 *leaf_weights, u32 num_leaves) {
+    print_u32s("u32", name, "shift", v->shift, v->num_levels);
+    print_u64s(name, "offset", v->offset, v->num_levels);
+    print_u32s(index_type(leaves_width), name, "leaves", leaves, num_leaves);
+    print_u64s(name, "weights", leaf_weights, num_leaves);
+}
+
+static void print_leaf(const char *name, struct levels_s *v, const char *indent) {
+    // Find the level by the thresholds of all but the last level.
+    printf("%su32 d = 0", indent);
+    for (u32 j = 0; j + 1 < v->num_levels; ++j) {
+        printf("\n%s    + (flips >= %luull)", indent, v->threshold[j]);
+    }
+    printf(";\n");
+    printf("%su32 pos = %s_shift[d];\n", indent, name);
+    printf("%su64 i = (flips >> pos) - %s_offset[d];\n", indent, name);
+    printf("%su64 mask = (1ull << pos) - 1;\n", indent);
+    printf("%su64 recycle_bound = %s_weights[i];\n", indent, name);
+    printf("%smerge_state_local(state, bound, (flips & mask) + (recycle_bound & mask), recycle_bound);\n", indent);
+    printf("%sreturn %s_leaves[i];\n", indent, name);
+}
+
+static void print_wrappers(const char *name) {
+    printf("static inline u32 sample_%s_r(struct rr_state *s) {\n", name);
+    printf("    return sample_%s_local(s, &s->unif_state, &s->unif_bound);\n", name);
+    printf("}\n\n");
+    printf("static inline u32 sample_%s(void) {\n", name);
+    printf("    return sample_%s_r(&rr_default);\n", name);
+    printf("}\n\n");
+    printf("static inline void sample_%s_n_r(struct rr_state *s, u32 *out, u64 count) {\n", name);
+    printf("    rr_uint state = s->unif_state;\n");
+    printf("    rr_uint bound = s->unif_bound;\n");
+    printf("    for (u64 i = 0; i < count; ++i) {\n");
+    printf("        out[i] = sample_%s_local(s, &state, &bound);\n", name);
+    printf("    }\n");
+    printf("    s->unif_state = state;\n");
+    printf("    s->unif_bound = bound;\n");
+    printf("}\n\n");
+    printf("static inline void sample_%s_n(u32 *out, u64 count) {\n", name);
+    printf("    sample_%s_n_r(&rr_default, out, count);\n", name);
+    printf("}\n\n");
+}
+
+static void generate_fldr(const char *name, u32 *a, u32 n) {
+    struct fldr_eo_s f = preprocess_fldr_eo(a, n);
+    struct levels_s v = compute_levels(f.breadths, f.length_breadths);
+    u32 *leaves = malloc(f.length_leaves_flat * sizeof(u32));
+    u64 *leaf_weights = malloc(f.length_leaves_flat * sizeof(u64));
+    for (u32 i = 0; i < f.length_leaves_flat; ++i) {
+        leaves[i] = index_get(f.leaves_flat, f.leaves_width, i);
+        leaf_weights[i] = f.weights[leaves[i]];
+    }
+    struct uniform_preprocessed_s u = f.uniform_preprocessed;
+    printf("static const struct uniform_preprocessed_s %s_uniform = {\n", name);
+    printf("    %u, %u, %u, %luull\n};\n\n", u.num_outcomes, u.quotient, u.not_remainder, u.inverse);
+    print_tables(name, &v, leaves, f.leaves_width, leaf_weights, f.length_leaves_flat);
+
+    printf("static inline u32 sample_%s_local(struct rr_state *s, rr_uint *state, rr_uint *bound) {\n", name);
+    printf("    u64 flips = uniform_prediv_local(s, state, bound, &%s_uniform);\n", name);
+    print_leaf(name, &v, "    ");
+    printf("}\n\n");
+    print_wrappers(name);
+    free(leaves);
+    free(leaf_weights);
+    free_levels(v);
+    free_fldr_eo(f);
+}
+
+static void generate_aldr(const char *name, u32 *a, u32 n) {
+    struct aldr_recycle_s f = preprocess_aldr_recycle(a, n);
+    struct levels_s v = compute_levels(f.breadths, f.length_breadths);
+    u32 num_flips = f.length_breadths - 1;
+    u64 accept = (1ull << num_flips) - f.reject_weight;
+    u32 *leaves = malloc(f.length_leaves_flat * sizeof(u32));
+    u64 *leaf_weights = malloc(f.length_leaves_flat * sizeof(u64));
+    for (u32 i = 0; i < f.length_leaves_flat; ++i) {
+        leaves[i] = index_get(f.leaves_flat, f.leaves_width, i);
+        leaf_weights[i] = index_get(f.weights, f.weights_width, leaves[i]);
+    }
+    print_tables(name, &v, leaves, f.leaves_width, leaf_weights, f.length_leaves_flat);
+
+    printf("static inline u32 sample_%s_local(struct rr_state *s, rr_uint *state, rr_uint *bound) {\n", name);
+    printf("    for (;;) {\n");
+    printf("        u64 flips = flip_n_from_unif_local(s, state, bound, %u);\n", num_flips);
+    if (f.reject_weight > 0) {
+        printf("        if (unlikely(flips >= %luull)) {\n", accept);
+        printf("            rr_lost(s, lost_aldr, %luull, %luull);\n", (u64)1 << num_flips, (u64)f.reject_weight);
+        printf("            rr_count(s, aldr_rejections, 1);\n");
+        printf("            merge_state_local(state, bound, flips - %luull, %luull);\n", accept, (u64)f.reject_weight);
+        printf("            continue;\n");
+        printf("        }\n");
+    }
+    printf("        rr_lost(s, lost_aldr, %luull, %luull);\n", (u64)1 << num_flips, accept);
+    print_leaf(name, &v, "        ");
+    printf("    }\n");
+    printf("}\n\n");
+    print_wrappers(name);
+    free(leaves);
+    free(leaf_weights);
+    free_levels(v);
+    free_aldr_recycle(f);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        printf("usage: %s <sampler> <name> <distribution>\n", argv[0]);
+        printf("<sampler>        one of: fldr, aldr\n");
+        printf("<name>           C identifier of the generated sampler\n");
+        printf("<distribution>   space-separated list of positive integers (e.g., 5 5 1)\n\n");
+        printf("Writes to standard output a header defining sample_<name>,\n");
+        printf("sample_<name>_r, sample_<name>_n and sample_<name>_n_r, which return\n");
+        printf("the same samples as sample_fldr_eo or sample_aldr_recycle on a table\n");
+        printf("of the distribution, and recycle the same state.\n\n");
+        printf("example:\n");
+        printf("  %s aldr loot 1 1 2 3 2 > loot.h\n", argv[0]);
+        exit(0);
+    }
+    char *var_sampler = argv[1];
+    char *name = argv[2];
+    for (char *c = name; *c; ++c) {
+        if (!(isalnum(*c) || *c == '_') || isdigit(name[0])) {
+            fprintf(stderr, "not a C identifier: %s\n", name);
+            return 1;
+        }
+    }
+
+    // Parse the distribution.
+    u32 n = argc - 3;
+    u32 *a = calloc(n, sizeof(*a));
+    u64 m = 0;
+    for (u32 i = 0; i < n; ++i) {
+        a[i] = strtoul(argv[i + 3], NULL, 10);
+        m += a[i];
+    }
+    if (m == 0 || m >> 31) {
+        fprintf(stderr, "the weights must sum to between 1 and 2^31 - 1\n");
+        free(a);
+        return 1;
+    }
+
+    void (*generate)(const char *name, u32 *a, u32 n) =
+        strcmp(var_sampler, "fldr") == 0 ? generate_fldr
+        : strcmp(var_sampler, "aldr") == 0 ? generate_aldr
+        : NULL;
+    if (generate == NULL) {
+        fprintf(stderr, "unknown sampler: %s\n", var_sampler);
+        free(a);
+        return 1;
+    }
+
+    // uniform_preprocess needs at least two outcomes.
+    if (generate == generate_fldr && m == 1) {
+        fprintf(stderr, "fldr needs weights summing to at least 2\n");
+        free(a);
+        return 1;
+    }
+
+    char *guard = strdup(name);
+    for (char *c = guard; *c; ++c) {
+        *c = toupper(*c);
+    }
+    printf("// Generated by gen_rr %s %s", var_sampler, name);
+    for (u32 i = 0; i < n && i < 16; ++i) {
+        printf(" %u", a[i]);
+    }
+    printf("%s; do not edit.\n\n", n > 16 ? " ..." : "");
+    printf("#ifndef %s_H\n#define %s_H\n\n", guard, guard);
+    printf("#include \"types.h\"\n#include \"uniform.h\"\n\n");
+
+    generate(name, a, n);
+    printf("#endif\n");
+
+    free(guard);
+    free(a);
+    return 0;
+}
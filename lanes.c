@@ -0,0 +1,613 @@
+/*
+  Name:     lanes.c
+  Purpose:  Multi-lane sampling with independent recycling states.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LANES_HAVE_X86 1
+#endif
+
+#include "lanes.h"
+#include "source.h"
+#include "uniform.h"
+
+// Every implementation runs the same rounds on the lanes still pending:
+// top up the shared buffer, check_refill_uniform, then
+// uniform_u32_from_unif and the uniform_prediv test. Fresh words are
+// handed out in lane order within each round, so all implementations
+// consume the same words and produce the same samples.
+
+bool lanes_available(enum lanes_isa isa) {
+    switch (isa) {
+    case LANES_SCALAR:
+        return 1;
+    case LANES_AVX2:
+#ifdef LANES_HAVE_X86
+        return __builtin_cpu_supports("avx2");
+#else
+        return 0;
+#endif
+    case LANES_AVX512:
+#ifdef LANES_HAVE_X86
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd");
+#else
+        return 0;
+#endif
+    }
+    return 0;
+}
+
+void rr_lanes_init(struct rr_lanes_s *l, struct bit_source_s source) {
+    memset(l, 0, sizeof(*l));
+    for (u32 j = 0; j < RR_LANES; ++j) {
+        l->unif_bound[j] = 1;
+    }
+    l->source = source;
+    l->isa = LANES_SCALAR;
+    if (lanes_available(LANES_AVX2)) l->isa = LANES_AVX2;
+    if (lanes_available(LANES_AVX512)) l->isa = LANES_AVX512;
+}
+
+static void lanes_top_up(struct rr_lanes_s *l) {
+    // Keep at least RR_LANES words ahead of each round, carrying the
+    // unused words over so that none are skipped.
+    u32 left = l->buffer_end - l->buffer_pos;
+    if (likely(left >= RR_LANES)) {
+        return;
+    }
+    memmove(l->buffer, l->buffer + l->buffer_pos, left * sizeof(u64));
+    if (unlikely(l->source.fill == NULL)) {
+        l->source = source_new(SOURCE_GETRANDOM);
+    }
+    l->source.fill(&l->source, l->buffer + left, SOURCE_BUFFER_WORDS);
+    l->buffer_pos = 0;
+    l->buffer_end = left + SOURCE_BUFFER_WORDS;
+}
+
+// scalar
+
+static u64 take_scalar(struct rr_lanes_s *l, u32 j, u32 n) {
+    // Input 8 <= n <= 63; flip_pos stays in [0, 63].
+    u64 fp = l->flip_pos[j];
+    u64 fw = l->flip_word[j];
+    if (n <= fp) {
+        l->flip_pos[j] = fp - n;
+        return (fw >> (fp - n)) & ((1ull << n) - 1);
+    }
+    u32 r = n - fp;
+    u64 w = l->buffer[l->buffer_pos++];
+    l->flip_word[j] = w;
+    l->flip_pos[j] = 64 - r;
+    return ((fw & ((1ull << fp) - 1)) << r) | (w >> (64 - r));
+}
+
+static void draw_scalar(struct rr_lanes_s *l, const struct uniform_preprocessed_s *p,
+        u32 active, u64 u_out[RR_LANES]) {
+    u32 pending = active;
+    while (pending) {
+        lanes_top_up(l);
+        for (u32 j = 0; j < RR_LANES; ++j) {
+            if (!((pending >> j) & 1)) continue;
+            u64 state = l->unif_state[j];
+            u64 bound = l->unif_bound[j];
+            u32 n = __builtin_clzll(bound);
+            if (n >= 8) {
+                state = (state << n) | take_scalar(l, j, n);
+                bound <<= n;
+            }
+            u64 q_state = state >> 32;
+            u64 q_bound = bound >> 32;
+            if (q_state < q_bound) {
+                u32 u = state;
+                state = q_state;
+                bound = q_bound;
+                u64 unifm_rem = (u64)u * p->num_outcomes;
+                if ((u32)unifm_rem <= p->not_remainder) {
+                    u32 unifm = unifm_rem >> 32;
+                    u32 lower_bound = (p->inverse * unifm) >> 32;
+                    state = state * p->quotient + (u32)(u - lower_bound);
+                    bound *= p->quotient;
+                    u_out[j] = unifm;
+                    pending &= ~(1u << j);
+                }
+            } else {
+                state = (u32)state;
+                bound = (u32)bound;
+            }
+            l->unif_state[j] = state;
+            l->unif_bound[j] = bound;
+        }
+    }
+}
+
+static void finish_lookup_scalar(struct rr_lanes_s *l, const struct lookup_eo_s *x,
+        u32 active, const u64 u[RR_LANES], u32 out[RR_LANES]) {
+    SWITCH_INDEX_WIDTH(lookup_width, x->lookup_width,
+        for (u32 j = 0; j < RR_LANES; ++j) {
+            if (!((active >> j) & 1)) continue;
+            u32 result = index_get(x->lookup, lookup_width, u[j]);
+            u32 lo = x->cdf[result];
+            u32 width = x->cdf[result + 1] - lo;
+            l->unif_state[j] = l->unif_state[j] * width + (u[j] - lo);
+            l->unif_bound[j] *= width;
+            out[j] = result;
+        }
+    )
+}
+
+static void finish_alias_scalar(struct rr_lanes_s *l, const struct weighted_alias_s *x,
+        u32 active, const u64 column[RR_LANES], const u64 coin[RR_LANES], u32 out[RR_LANES]) {
+    for (u32 j = 0; j < RR_LANES; ++j) {
+        if (!((active >> j) & 1)) continue;
+        u32 odds = x->no_alias_odds[column[j]];
+        u64 recycle_state = coin[j];
+        u64 recycle_bound = odds;
+        out[j] = column[j];
+        if (coin[j] >= odds) {
+            recycle_state -= odds;
+            recycle_bound = x->weight_sum - odds;
+            out[j] = x->aliases[column[j]];
+        }
+        l->unif_state[j] = l->unif_state[j] * recycle_bound + recycle_state;
+        l->unif_bound[j] *= recycle_bound;
+    }
+}
+
+#ifdef LANES_HAVE_X86
+
+// AVX-512: lanes 0-7 and 8-15 in two vectors.
+
+#define AVX512 __attribute__((target("avx512f,avx512cd")))
+
+AVX512
+static inline __m512i mul64x32_avx512(__m512i a, __m512i b) {
+    // Low 64 bits of a * b for b < 2^32.
+    __m512i lo = _mm512_mul_epu32(a, b);
+    __m512i hi = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), b);
+    return _mm512_add_epi64(lo, _mm512_slli_epi64(hi, 32));
+}
+
+AVX512
+static void draw_avx512(struct rr_lanes_s *l, const struct uniform_preprocessed_s *p,
+        u32 active, u64 u_out[RR_LANES]) {
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i c8 = _mm512_set1_epi64(8);
+    const __m512i c64 = _mm512_set1_epi64(64);
+    const __m512i low32 = _mm512_set1_epi64(UINT32_MAX);
+    const __m512i m = _mm512_set1_epi64(p->num_outcomes);
+    const __m512i not_remainder = _mm512_set1_epi64(p->not_remainder);
+    const __m512i quotient = _mm512_set1_epi64(p->quotient);
+    const __m512i inverse = _mm512_set1_epi64(p->inverse);
+    u32 pending = active;
+    while (pending) {
+        lanes_top_up(l);
+        for (u32 v = 0; v < RR_LANES; v += 8) {
+            __mmask8 k = pending >> v;
+            if (!k) continue;
+            __m512i state = _mm512_loadu_si512(l->unif_state + v);
+            __m512i bound = _mm512_loadu_si512(l->unif_bound + v);
+            __m512i fw = _mm512_loadu_si512(l->flip_word + v);
+            __m512i fp = _mm512_loadu_si512(l->flip_pos + v);
+
+            // check_refill_uniform, taking n bits from each reservoir
+            // and a fresh word where the reservoir runs out.
+            __m512i n = _mm512_lzcnt_epi64(bound);
+            __mmask8 need = k & _mm512_cmpge_epu64_mask(n, c8);
+            __mmask8 fresh = need & _mm512_cmpgt_epu64_mask(n, fp);
+            __m512i w = _mm512_maskz_expandloadu_epi64(fresh, l->buffer + l->buffer_pos);
+            l->buffer_pos += __builtin_popcount(fresh);
+            __m512i r = _mm512_sub_epi64(n, fp);
+            __m512i bits_kept = _mm512_and_si512(_mm512_srlv_epi64(fw, _mm512_sub_epi64(fp, n)),
+                _mm512_sub_epi64(_mm512_sllv_epi64(one, n), one));
+            __m512i bits_fresh = _mm512_or_si512(
+                _mm512_sllv_epi64(_mm512_and_si512(fw, _mm512_sub_epi64(_mm512_sllv_epi64(one, fp), one)), r),
+                _mm512_srlv_epi64(w, _mm512_sub_epi64(c64, r)));
+            __m512i bits = _mm512_mask_blend_epi64(fresh, bits_kept, bits_fresh);
+            fp = _mm512_mask_mov_epi64(fp, need, _mm512_sub_epi64(fp, n));
+            fp = _mm512_mask_mov_epi64(fp, fresh, _mm512_sub_epi64(c64, r));
+            fw = _mm512_mask_mov_epi64(fw, fresh, w);
+            state = _mm512_mask_mov_epi64(state, need, _mm512_or_si512(_mm512_sllv_epi64(state, n), bits));
+            bound = _mm512_mask_mov_epi64(bound, need, _mm512_sllv_epi64(bound, n));
+
+            // uniform_u32_from_unif
+            __m512i q_state = _mm512_srli_epi64(state, 32);
+            __m512i q_bound = _mm512_srli_epi64(bound, 32);
+            __mmask8 accept = k & _mm512_cmplt_epu64_mask(q_state, q_bound);
+            __mmask8 reject = k & ~accept;
+            __m512i u = _mm512_and_si512(state, low32);
+            state = _mm512_mask_mov_epi64(state, reject, u);
+            bound = _mm512_mask_mov_epi64(bound, reject, _mm512_and_si512(bound, low32));
+            state = _mm512_mask_mov_epi64(state, accept, q_state);
+            bound = _mm512_mask_mov_epi64(bound, accept, q_bound);
+
+            // uniform_prediv; state and bound are below 2^32 here.
+            __m512i unifm_rem = _mm512_mul_epu32(u, m);
+            __mmask8 done = accept
+                & _mm512_cmple_epu64_mask(_mm512_and_si512(unifm_rem, low32), not_remainder);
+            __m512i unifm = _mm512_srli_epi64(unifm_rem, 32);
+            __m512i lower_bound = _mm512_srli_epi64(mul64x32_avx512(inverse, unifm), 32);
+            __m512i recycle = _mm512_and_si512(_mm512_sub_epi64(u, lower_bound), low32);
+            state = _mm512_mask_mov_epi64(state, done,
+                _mm512_add_epi64(_mm512_mul_epu32(state, quotient), recycle));
+            bound = _mm512_mask_mov_epi64(bound, done, _mm512_mul_epu32(bound, quotient));
+            _mm512_mask_storeu_epi64(u_out + v, done, unifm);
+
+            _mm512_storeu_si512(l->unif_state + v, state);
+            _mm512_storeu_si512(l->unif_bound + v, bound);
+            _mm512_storeu_si512(l->flip_word + v, fw);
+            _mm512_storeu_si512(l->flip_pos + v, fp);
+            pending &= ~((u32)done << v);
+        }
+    }
+}
+
+// Entries index of the index array a of the given width, by 4-byte
+// loads masked to the width; the array is padded for the last load.
+AVX512
+static inline __m256i gather_index_avx512(__m512i index, const void *a, u32 width) {
+    switch (width) {
+    case 1:
+        return _mm256_and_si256(_mm512_i64gather_epi32(index, a, 1), _mm256_set1_epi32(0xff));
+    case 2:
+        return _mm256_and_si256(_mm512_i64gather_epi32(index, a, 2), _mm256_set1_epi32(0xffff));
+    default:
+        return _mm512_i64gather_epi32(index, a, 4);
+    }
+}
+
+AVX512
+static void finish_lookup_avx512(struct rr_lanes_s *l, const struct lookup_eo_s *x,
+        u32 active, const u64 u[RR_LANES], u32 out[RR_LANES]) {
+    // Inactive lanes hold u = 0, a valid index, and are left unchanged.
+    for (u32 v = 0; v < RR_LANES; v += 8) {
+        __mmask8 k = active >> v;
+        __m512i unifm = _mm512_loadu_si512(u + v);
+        __m512i result = _mm512_cvtepu32_epi64(gather_index_avx512(unifm, x->lookup, x->lookup_width));
+        __m512i lo = _mm512_cvtepu32_epi64(_mm512_i64gather_epi32(result, x->cdf, 4));
+        __m512i hi = _mm512_cvtepu32_epi64(_mm512_i64gather_epi32(result, x->cdf + 1, 4));
+        __m512i width = _mm512_sub_epi64(hi, lo);
+        __m512i state = _mm512_loadu_si512(l->unif_state + v);
+        __m512i bound = _mm512_loadu_si512(l->unif_bound + v);
+        state = _mm512_mask_mov_epi64(state, k,
+            _mm512_add_epi64(mul64x32_avx512(state, width), _mm512_sub_epi64(unifm, lo)));
+        bound = _mm512_mask_mov_epi64(bound, k, mul64x32_avx512(bound, width));
+        _mm512_storeu_si512(l->unif_state + v, state);
+        _mm512_storeu_si512(l->unif_bound + v, bound);
+        _mm256_storeu_si256((__m256i *)(out + v), _mm512_cvtepi64_epi32(result));
+    }
+}
+
+AVX512
+static void finish_alias_avx512(struct rr_lanes_s *l, const struct weighted_alias_s *x,
+        u32 active, const u64 column[RR_LANES], const u64 coin[RR_LANES], u32 out[RR_LANES]) {
+    const __m512i weight_sum = _mm512_set1_epi64(x->weight_sum);
+    for (u32 v = 0; v < RR_LANES; v += 8) {
+        __mmask8 k = active >> v;
+        __m512i col = _mm512_loadu_si512(column + v);
+        __m512i c = _mm512_loadu_si512(coin + v);
+        __m512i odds = _mm512_cvtepu32_epi64(_mm512_i64gather_epi32(col, x->no_alias_odds, 4));
+        __m512i alias = _mm512_cvtepu32_epi64(_mm512_i64gather_epi32(col, x->aliases, 4));
+        __mmask8 to_alias = _mm512_cmpge_epu64_mask(c, odds);
+        __m512i result = _mm512_mask_mov_epi64(col, to_alias, alias);
+        __m512i recycle_state = _mm512_mask_sub_epi64(c, to_alias, c, odds);
+        __m512i recycle_bound = _mm512_mask_sub_epi64(odds, to_alias, weight_sum, odds);
+        __m512i state = _mm512_loadu_si512(l->unif_state + v);
+        __m512i bound = _mm512_loadu_si512(l->unif_bound + v);
+        state = _mm512_mask_mov_epi64(state, k,
+            _mm512_add_epi64(mul64x32_avx512(state, recycle_bound), recycle_state));
+        bound = _mm512_mask_mov_epi64(bound, k, mul64x32_avx512(bound, recycle_bound));
+        _mm512_storeu_si512(l->unif_state + v, state);
+        _mm512_storeu_si512(l->unif_bound + v, bound);
+        _mm256_storeu_si256((__m256i *)(out + v), _mm512_cvtepi64_epi32(result));
+    }
+}
+
+// AVX2: lanes 0-3, 4-7, 8-11 and 12-15 in four vectors. Every compared
+// value is below 2^63, so the signed comparisons are exact.
+
+#define AVX2 __attribute__((target("avx2")))
+
+// Permutations of 32-bit halves that emulate an expanding load:
+// lane j of mask b takes word popcount(b & ((1 << j) - 1)).
+static const u32 expand_avx2[16][8] __attribute__((aligned(32))) = {
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 1, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 1, 0, 0, 0, 0 },
+    { 0, 1, 2, 3, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 1, 0, 0 },
+    { 0, 1, 0, 0, 2, 3, 0, 0 },
+    { 0, 0, 0, 1, 2, 3, 0, 0 },
+    { 0, 1, 2, 3, 4, 5, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 1 },
+    { 0, 1, 0, 0, 0, 0, 2, 3 },
+    { 0, 0, 0, 1, 0, 0, 2, 3 },
+    { 0, 1, 2, 3, 0, 0, 4, 5 },
+    { 0, 0, 0, 0, 0, 1, 2, 3 },
+    { 0, 1, 0, 0, 2, 3, 4, 5 },
+    { 0, 0, 0, 1, 2, 3, 4, 5 },
+    { 0, 1, 2, 3, 4, 5, 6, 7 },
+};
+
+AVX2
+static inline __m256i mask_avx2(u32 k) {
+    const __m256i bits = _mm256_set_epi64x(8, 4, 2, 1);
+    return _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(k), bits), bits);
+}
+
+AVX2
+static inline u32 movemask_avx2(__m256i x) {
+    return _mm256_movemask_pd(_mm256_castsi256_pd(x));
+}
+
+AVX2
+static inline __m256i select_avx2(__m256i mask, __m256i a, __m256i b) {
+    // mask ? b : a
+    return _mm256_blendv_epi8(a, b, mask);
+}
+
+AVX2
+static inline __m256i lzcnt_avx2(__m256i x) {
+    // Input x > 0.
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i n = zero;
+    __m256i z;
+#define LZCNT_STEP(k)                                                       \
+    z = _mm256_cmpeq_epi64(_mm256_srli_epi64(x, 64 - (k)), zero);          \
+    n = _mm256_add_epi64(n, _mm256_and_si256(z, _mm256_set1_epi64x(k)));   \
+    x = select_avx2(z, x, _mm256_slli_epi64(x, k));
+    LZCNT_STEP(32)
+    LZCNT_STEP(16)
+    LZCNT_STEP(8)
+    LZCNT_STEP(4)
+    LZCNT_STEP(2)
+    LZCNT_STEP(1)
+#undef LZCNT_STEP
+    return n;
+}
+
+AVX2
+static inline __m256i mul64x32_avx2(__m256i a, __m256i b) {
+    // Low 64 bits of a * b for b < 2^32.
+    __m256i lo = _mm256_mul_epu32(a, b);
+    __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+}
+
+AVX2
+static inline void store_u32_avx2(u32 *out, __m256i x) {
+    // Store the low halves of the four lanes.
+    const __m256i evens = _mm256_set_epi32(0, 0, 0, 0, 6, 4, 2, 0);
+    _mm_storeu_si128((__m128i *)out,
+        _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(x, evens)));
+}
+
+AVX2
+static void draw_avx2(struct rr_lanes_s *l, const struct uniform_preprocessed_s *p,
+        u32 active, u64 u_out[RR_LANES]) {
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i c7 = _mm256_set1_epi64x(7);
+    const __m256i c64 = _mm256_set1_epi64x(64);
+    const __m256i low32 = _mm256_set1_epi64x(UINT32_MAX);
+    const __m256i m = _mm256_set1_epi64x(p->num_outcomes);
+    const __m256i not_remainder = _mm256_set1_epi64x(p->not_remainder);
+    const __m256i quotient = _mm256_set1_epi64x(p->quotient);
+    const __m256i inverse = _mm256_set1_epi64x(p->inverse);
+    u32 pending = active;
+    while (pending) {
+        lanes_top_up(l);
+        for (u32 v = 0; v < RR_LANES; v += 4) {
+            u32 bits_k = (pending >> v) & 0xf;
+            if (!bits_k) continue;
+            __m256i k = mask_avx2(bits_k);
+            __m256i state = _mm256_loadu_si256((__m256i *)(l->unif_state + v));
+            __m256i bound = _mm256_loadu_si256((__m256i *)(l->unif_bound + v));
+            __m256i fw = _mm256_loadu_si256((__m256i *)(l->flip_word + v));
+            __m256i fp = _mm256_loadu_si256((__m256i *)(l->flip_pos + v));
+
+            // check_refill_uniform, as in draw_avx512.
+            __m256i n = lzcnt_avx2(bound);
+            __m256i need = _mm256_and_si256(k, _mm256_cmpgt_epi64(n, c7));
+            __m256i fresh = _mm256_and_si256(need, _mm256_cmpgt_epi64(n, fp));
+            u32 bits_fresh = movemask_avx2(fresh);
+            __m256i w = _mm256_permutevar8x32_epi32(
+                _mm256_loadu_si256((__m256i *)(l->buffer + l->buffer_pos)),
+                _mm256_load_si256((const __m256i *)expand_avx2[bits_fresh]));
+            l->buffer_pos += __builtin_popcount(bits_fresh);
+            __m256i r = _mm256_sub_epi64(n, fp);
+            __m256i kept = _mm256_and_si256(_mm256_srlv_epi64(fw, _mm256_sub_epi64(fp, n)),
+                _mm256_sub_epi64(_mm256_sllv_epi64(one, n), one));
+            __m256i from_fresh = _mm256_or_si256(
+                _mm256_sllv_epi64(_mm256_and_si256(fw, _mm256_sub_epi64(_mm256_sllv_epi64(one, fp), one)), r),
+                _mm256_srlv_epi64(w, _mm256_sub_epi64(c64, r)));
+            __m256i bits = select_avx2(fresh, kept, from_fresh);
+            fp = select_avx2(need, fp, _mm256_sub_epi64(fp, n));
+            fp = select_avx2(fresh, fp, _mm256_sub_epi64(c64, r));
+            fw = select_avx2(fresh, fw, w);
+            state = select_avx2(need, state, _mm256_or_si256(_mm256_sllv_epi64(state, n), bits));
+            bound = select_avx2(need, bound, _mm256_sllv_epi64(bound, n));
+
+            // uniform_u32_from_unif
+            __m256i q_state = _mm256_srli_epi64(state, 32);
+            __m256i q_bound = _mm256_srli_epi64(bound, 32);
+            __m256i accept = _mm256_and_si256(k, _mm256_cmpgt_epi64(q_bound, q_state));
+            __m256i reject = _mm256_andnot_si256(accept, k);
+            __m256i u = _mm256_and_si256(state, low32);
+            state = select_avx2(reject, state, u);
+            bound = select_avx2(reject, bound, _mm256_and_si256(bound, low32));
+            state = select_avx2(accept, state, q_state);
+            bound = select_avx2(accept, bound, q_bound);
+
+            // uniform_prediv
+            __m256i unifm_rem = _mm256_mul_epu32(u, m);
+            __m256i done = _mm256_andnot_si256(
+                _mm256_cmpgt_epi64(_mm256_and_si256(unifm_rem, low32), not_remainder), accept);
+            __m256i unifm = _mm256_srli_epi64(unifm_rem, 32);
+            __m256i lower_bound = _mm256_srli_epi64(mul64x32_avx2(inverse, unifm), 32);
+            __m256i recycle = _mm256_and_si256(_mm256_sub_epi64(u, lower_bound), low32);
+            state = select_avx2(done, state,
+                _mm256_add_epi64(_mm256_mul_epu32(state, quotient), recycle));
+            bound = select_avx2(done, bound, _mm256_mul_epu32(bound, quotient));
+            _mm256_maskstore_epi64((long long *)(u_out + v), done, unifm);
+
+            _mm256_storeu_si256((__m256i *)(l->unif_state + v), state);
+            _mm256_storeu_si256((__m256i *)(l->unif_bound + v), bound);
+            _mm256_storeu_si256((__m256i *)(l->flip_word + v), fw);
+            _mm256_storeu_si256((__m256i *)(l->flip_pos + v), fp);
+            pending &= ~(movemask_avx2(done) << v);
+        }
+    }
+}
+
+AVX2
+static inline __m128i gather_index_avx2(__m256i index, const void *a, u32 width) {
+    switch (width) {
+    case 1:
+        return _mm_and_si128(_mm256_i64gather_epi32((const int *)a, index, 1), _mm_set1_epi32(0xff));
+    case 2:
+        return _mm_and_si128(_mm256_i64gather_epi32((const int *)a, index, 2), _mm_set1_epi32(0xffff));
+    default:
+        return _mm256_i64gather_epi32((const int *)a, index, 4);
+    }
+}
+
+AVX2
+static void finish_lookup_avx2(struct rr_lanes_s *l, const struct lookup_eo_s *x,
+        u32 active, const u64 u[RR_LANES], u32 out[RR_LANES]) {
+    for (u32 v = 0; v < RR_LANES; v += 4) {
+        __m256i k = mask_avx2((active >> v) & 0xf);
+        __m256i unifm = _mm256_loadu_si256((const __m256i *)(u + v));
+        __m256i result = _mm256_cvtepu32_epi64(gather_index_avx2(unifm, x->lookup, x->lookup_width));
+        __m256i lo = _mm256_cvtepu32_epi64(_mm256_i64gather_epi32((const int *)x->cdf, result, 4));
+        __m256i hi = _mm256_cvtepu32_epi64(_mm256_i64gather_epi32((const int *)x->cdf + 1, result, 4));
+        __m256i width = _mm256_sub_epi64(hi, lo);
+        __m256i state = _mm256_loadu_si256((__m256i *)(l->unif_state + v));
+        __m256i bound = _mm256_loadu_si256((__m256i *)(l->unif_bound + v));
+        state = select_avx2(k, state,
+            _mm256_add_epi64(mul64x32_avx2(state, width), _mm256_sub_epi64(unifm, lo)));
+        bound = select_avx2(k, bound, mul64x32_avx2(bound, width));
+        _mm256_storeu_si256((__m256i *)(l->unif_state + v), state);
+        _mm256_storeu_si256((__m256i *)(l->unif_bound + v), bound);
+        store_u32_avx2(out + v, result);
+    }
+}
+
+AVX2
+static void finish_alias_avx2(struct rr_lanes_s *l, const struct weighted_alias_s *x,
+        u32 active, const u64 column[RR_LANES], const u64 coin[RR_LANES], u32 out[RR_LANES]) {
+    const __m256i weight_sum = _mm256_set1_epi64x(x->weight_sum);
+    for (u32 v = 0; v < RR_LANES; v += 4) {
+        __m256i k = mask_avx2((active >> v) & 0xf);
+        __m256i col = _mm256_loadu_si256((const __m256i *)(column + v));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(coin + v));
+        __m256i odds = _mm256_cvtepu32_epi64(_mm256_i64gather_epi32((const int *)x->no_alias_odds, col, 4));
+        __m256i alias = _mm256_cvtepu32_epi64(_mm256_i64gather_epi32((const int *)x->aliases, col, 4));
+        __m256i to_alias = _mm256_xor_si256(_mm256_cmpgt_epi64(odds, c), _mm256_set1_epi64x(-1));
+        __m256i result = select_avx2(to_alias, col, alias);
+        __m256i recycle_state = select_avx2(to_alias, c, _mm256_sub_epi64(c, odds));
+        __m256i recycle_bound = select_avx2(to_alias, odds, _mm256_sub_epi64(weight_sum, odds));
+        __m256i state = _mm256_loadu_si256((__m256i *)(l->unif_state + v));
+        __m256i bound = _mm256_loadu_si256((__m256i *)(l->unif_bound + v));
+        state = select_avx2(k, state,
+            _mm256_add_epi64(mul64x32_avx2(state, recycle_bound), recycle_state));
+        bound = select_avx2(k, bound, mul64x32_avx2(bound, recycle_bound));
+        _mm256_storeu_si256((__m256i *)(l->unif_state + v), state);
+        _mm256_storeu_si256((__m256i *)(l->unif_bound + v), bound);
+        store_u32_avx2(out + v, result);
+    }
+}
+
+#endif
+
+// dispatch
+
+static void draw_lanes(struct rr_lanes_s *l, const struct uniform_preprocessed_s *p,
+        u32 active, u64 u_out[RR_LANES]) {
+    // unif[0, 1) needs no randomness, and uniform_preprocess excludes it.
+    if (unlikely(p->num_outcomes == 1)) {
+        return;
+    }
+    switch (l->isa) {
+#ifdef LANES_HAVE_X86
+    case LANES_AVX512:
+        draw_avx512(l, p, active, u_out);
+        return;
+    case LANES_AVX2:
+        draw_avx2(l, p, active, u_out);
+        return;
+#endif
+    default:
+        draw_scalar(l, p, active, u_out);
+    }
+}
+
+static u32 active_lanes(u64 remaining) {
+    return remaining >= RR_LANES ? (u32)((1ull << RR_LANES) - 1) : (u32)((1ull << remaining) - 1);
+}
+
+void sample_lookup_eo_lanes(struct rr_lanes_s *l, struct lookup_eo_s *x, u32 *out, u64 count) {
+    assert(lanes_available(l->isa));
+    struct uniform_preprocessed_s p = { .num_outcomes = 1 };
+    if (x->lookup_length > 1) {
+        p = uniform_preprocess(x->lookup_length);
+    }
+    for (u64 i = 0; i < count; i += RR_LANES) {
+        u32 active = active_lanes(count - i);
+        u64 u[RR_LANES] = { 0 };
+        u32 result[RR_LANES];
+        draw_lanes(l, &p, active, u);
+        switch (l->isa) {
+#ifdef LANES_HAVE_X86
+        case LANES_AVX512:
+            finish_lookup_avx512(l, x, active, u, result);
+            break;
+        case LANES_AVX2:
+            finish_lookup_avx2(l, x, active, u, result);
+            break;
+#endif
+        default:
+            finish_lookup_scalar(l, x, active, u, result);
+        }
+        memcpy(out + i, result, min((u64)RR_LANES, count - i) * sizeof(u32));
+    }
+}
+
+void sample_weighted_alias_recycle_lanes(struct rr_lanes_s *l, struct weighted_alias_s *x, u32 *out, u64 count) {
+    assert(lanes_available(l->isa));
+    struct uniform_preprocessed_s p_column = { .num_outcomes = 1 };
+    struct uniform_preprocessed_s p_coin = { .num_outcomes = 1 };
+    if (x->length > 1) {
+        p_column = uniform_preprocess(x->length);
+    }
+    if (x->weight_sum > 1) {
+        p_coin = uniform_preprocess(x->weight_sum);
+    }
+    for (u64 i = 0; i < count; i += RR_LANES) {
+        u32 active = active_lanes(count - i);
+        u64 column[RR_LANES] = { 0 };
+        u64 coin[RR_LANES] = { 0 };
+        u32 result[RR_LANES];
+        draw_lanes(l, &p_column, active, column);
+        draw_lanes(l, &p_coin, active, coin);
+        switch (l->isa) {
+#ifdef LANES_HAVE_X86
+        case LANES_AVX512:
+            finish_alias_avx512(l, x, active, column, coin, result);
+            break;
+        case LANES_AVX2:
+            finish_alias_avx2(l, x, active, column, coin, result);
+            break;
+#endif
+        default:
+            finish_alias_scalar(l, x, active, column, coin, result);
+        }
+        memcpy(out + i, result, min((u64)RR_LANES, count - i) * sizeof(u32));
+    }
+}
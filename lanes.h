@@ -0,0 +1,57 @@
+/*
+  Name:     lanes.h
+  Purpose:  Multi-lane sampling with independent recycling states.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#ifndef LANES_H
+#define LANES_H
+
+#include "alias.h"
+#include "lookup.h"
+#include "source.h"
+#include "types.h"
+
+// Number of independent recycling states advanced together.
+#define RR_LANES 16
+
+enum lanes_isa {
+    LANES_SCALAR,   // portable C
+    LANES_AVX2,     // 4 lanes per vector (requires AVX2)
+    LANES_AVX512,   // 8 lanes per vector (requires AVX-512F and CD)
+};
+
+// Recycling states unif_state[j] ~ unif[0, unif_bound[j]) for RR_LANES
+// lanes, each with its own reservoir of flip_pos[j] unused low bits of
+// flip_word[j]. Fresh words come from one buffer and are handed to the
+// lanes that need them in lane order, so the output depends only on the
+// source and never on the instruction set.
+struct rr_lanes_s {
+    enum lanes_isa isa;
+    u32 buffer_pos;
+    u32 buffer_end;
+    u64 unif_state[RR_LANES];
+    u64 unif_bound[RR_LANES];
+    u64 flip_word[RR_LANES];
+    u64 flip_pos[RR_LANES];
+    struct bit_source_s source;
+    u64 buffer[RR_LANES + SOURCE_BUFFER_WORDS];
+};
+
+bool lanes_available(enum lanes_isa isa);
+
+// Start all lanes empty, using the widest available instruction set.
+void rr_lanes_init(struct rr_lanes_s *l, struct bit_source_s source);
+
+// Lane j writes out[j], out[j + RR_LANES], ...; every lane is exact.
+// Uniforms are drawn as in uniform_prediv. The lookup sampler then
+// recycles as sample_lookup_eo does; the alias sampler draws the column
+// and the coin separately, and recycles only the coin, as
+// sample_weighted_alias_recycle does.
+void sample_lookup_eo_lanes(struct rr_lanes_s *l, struct lookup_eo_s *x, u32 *out, u64 count);
+void sample_weighted_alias_recycle_lanes(struct rr_lanes_s *l, struct weighted_alias_s *x, u32 *out, u64 count);
+
+#endif
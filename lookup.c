@@ -7,48 +7,231 @@
   Released under Apache 2.0; refer to LICENSE.txt
 */
 
+#include <assert.h>
 #include <stdlib.h>
 
+#include "arena.h"
 #include "binarysearch.h"
 #include "lookup.h"
+#include "parallel.h"
 #include "types.h"
 #include "uniform.h"
 
-struct lookup_eo_s preprocess_lookup_eo(int* a, int n) {
-    struct array_s cdf = preprocess_cdf(a, n);
-    u32 m = cdf.a[cdf.length - 1];
+static struct lookup_eo_s lookup_eo_new(int* a, int n) {
+    u32 m = 0;
+    for (u32 i = 0; i < n; ++i) {
+        m += a[i];
+    }
     struct lookup_eo_s x = {
-        .cdf_length = cdf.length,
+        .cdf_length = n + 1,
         .lookup_length = m,
-        .cdf = cdf.a,
-        .lookup = malloc(m * sizeof(x.lookup[0]))
+        .lookup_width = index_width(n - 1),
+        .modulus = uniform_modulus(m)
+    };
+    u64 bytes[] = {
+        (u64)x.cdf_length * sizeof(x.cdf[0]),
+        lookup_eo_array_bytes(x.lookup_length, x.lookup_width)
     };
+    void *arrays[2];
+    x.block = table_block_new(2, bytes, arrays);
+    x.cdf = arrays[0];
+    x.lookup = arrays[1];
+    return x;
+}
+
+// Set lookup[begin, end) to the outcome i.
+static inline void lookup_fill_run(void *lookup, u32 width, u64 begin, u64 end, u32 i) {
+    SWITCH_INDEX_WIDTH(w, width,
+        for (u64 j = begin; j < end; ++j) {
+            index_set(lookup, w, j, i);
+        }
+    )
+}
+
+struct lookup_eo_s preprocess_lookup_eo(int* a, int n) {
+    struct lookup_eo_s x = lookup_eo_new(a, n);
+    fill_cdf(a, n, 1, x.cdf);
     for (u32 i = 0; i < n; ++i) {
-        for (u32 j = x.cdf[i]; j < x.cdf[i+1]; ++j) {
-            x.lookup[j] = i;
+        lookup_fill_run(x.lookup, x.lookup_width, x.cdf[i], x.cdf[i+1], i);
+    }
+    return x;
+}
+
+// Each thread fills a contiguous range of lookup entries, starting from
+// the outcome that covers the first entry of its range.
+static void lookup_fill(void *p, u32 t, u32 num_threads) {
+    struct lookup_eo_s *x = p;
+    u64 begin, end;
+    parallel_range(x->lookup_length, t, num_threads, &begin, &end);
+    if (begin == end) {
+        return;
+    }
+    // First outcome i with cdf[i+1] > begin.
+    u32 low = 0;
+    u32 high = x->cdf_length - 2;
+    while (low < high) {
+        u32 mid = (low + high) / 2;
+        if (x->cdf[mid + 1] > begin) {
+            high = mid;
+        } else {
+            low = mid + 1;
         }
     }
+    for (u64 j = begin; j < end; ++low) {
+        u64 stop = min((u64)x->cdf[low + 1], end);
+        lookup_fill_run(x->lookup, x->lookup_width, j, stop, low);
+        j = stop;
+    }
+}
+
+struct lookup_eo_s preprocess_lookup_eo_parallel(int* a, int n, u32 num_threads) {
+    struct lookup_eo_s x = lookup_eo_new(a, n);
+    fill_cdf(a, n, num_threads, x.cdf);
+    parallel_run(parallel_threads(num_threads, x.lookup_length), lookup_fill, &x);
     return x;
 }
 
-u32 sample_lookup_eo(struct lookup_eo_s *x) {
-    u32 uniform_index = uniform_eo(x->lookup_length);
-    u32 result = x->lookup[uniform_index];
-    merge_state(
+static inline u32 sample_lookup_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct lookup_eo_s *x, u32 width) {
+    u32 uniform_index = uniform_eo_mod_local(s, state, bound, &x->modulus);
+    u32 result = index_get(x->lookup, width, uniform_index);
+    merge_state_local(state, bound,
         uniform_index - x->cdf[result],
         x->cdf[result + 1] - x->cdf[result]
     );
     return result;
 }
 
+u32 sample_lookup_eo_r(struct rr_state *s, struct lookup_eo_s *x) {
+    return sample_lookup_eo_local(s, &s->unif_state, &s->unif_bound, x, x->lookup_width);
+}
+
+u32 sample_lookup_eo(struct lookup_eo_s *x) {
+    return sample_lookup_eo_r(&rr_default, x);
+}
+
+void sample_lookup_eo_n_r(struct rr_state *s, struct lookup_eo_s *x, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_lookup_eo_r.
+    const struct lookup_eo_s t = *x;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    SWITCH_INDEX_WIDTH(width, t.lookup_width,
+        for (u64 i = 0; i < count; ++i) {
+            out[i] = sample_lookup_eo_local(s, &state, &bound, &t, width);
+        }
+    )
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_lookup_eo_n(struct lookup_eo_s *x, u32 *out, u64 count) {
+    sample_lookup_eo_n_r(&rr_default, x, out, count);
+}
+
 void free_lookup_eo(struct lookup_eo_s x) {
-    free(x.cdf);
-    free(x.lookup);
+    table_block_free(x.block);
+}
+
+u64 bytes_lookup_eo(struct lookup_eo_s *x) {
+    u64 bytes[] = {
+        (u64)x->cdf_length * sizeof(x->cdf[0]),
+        lookup_eo_array_bytes(x->lookup_length, x->lookup_width)
+    };
+    return sizeof(*x) + table_block_bytes(2, bytes);
+}
+
+struct lookup_guide_s preprocess_lookup_guide(u32* a, u32 n, u32 num_buckets) {
+    // Use at most num_buckets buckets (n if zero) of width 1 << shift,
+    // so that the bucket of a draw is found by a shift, not a division.
+    if (num_buckets == 0) num_buckets = n;
+    u64 m = 0;
+    for (u32 i = 0; i < n; ++i) {
+        m += a[i];
+    }
+    assert(0 < m && m <= RR_MAX_RANGE);
+    u32 shift = 0;
+    while (((m - 1) >> shift) >= num_buckets) {
+        ++shift;
+    }
+    struct lookup_guide_s x = {
+        .cdf_length = n + 1,
+        .guide_length = ((m - 1) >> shift) + 1,
+        .shift = shift,
+        .modulus = uniform_modulus(m)
+    };
+    u64 bytes[] = {
+        (u64)x.cdf_length * sizeof(x.cdf[0]),
+        (u64)x.guide_length * sizeof(x.guide[0])
+    };
+    void *arrays[2];
+    x.block = table_block_new(2, bytes, arrays);
+    x.cdf = arrays[0];
+    x.guide = arrays[1];
+    u64 *cdf = x.cdf;
+    cdf[0] = 0;
+    for (u32 i = 0; i < n; ++i) {
+        cdf[i + 1] = cdf[i] + a[i];
+    }
+    // guide[j] is the outcome i with cdf[i] <= (j << shift) < cdf[i+1].
+    u32 i = 0;
+    for (u32 j = 0; j < x.guide_length; ++j) {
+        u64 start = (u64)j << shift;
+        while (cdf[i + 1] <= start) {
+            ++i;
+        }
+        x.guide[j] = i;
+    }
+    return x;
+}
+
+static inline u32 sample_lookup_guide_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct lookup_guide_s *x) {
+    u64 uniform_index = uniform_eo_mod_local(s, state, bound, &x->modulus);
+    u32 result = x->guide[uniform_index >> x->shift];
+    while (x->cdf[result + 1] <= uniform_index) {
+        ++result;
+    }
+    merge_state_local(state, bound,
+        uniform_index - x->cdf[result],
+        x->cdf[result + 1] - x->cdf[result]
+    );
+    return result;
+}
+
+u32 sample_lookup_guide_eo_r(struct rr_state *s, struct lookup_guide_s *x) {
+    return sample_lookup_guide_eo_local(s, &s->unif_state, &s->unif_bound, x);
+}
+
+u32 sample_lookup_guide_eo(struct lookup_guide_s *x) {
+    return sample_lookup_guide_eo_r(&rr_default, x);
 }
 
-u32 bytes_lookup_eo(struct lookup_eo_s *x) {
-    return sizeof(x->cdf_length) +
-           sizeof(x->lookup_length) +
-           x->cdf_length * sizeof(x->cdf[0]) +
-           x->lookup_length * sizeof(x->lookup[0]);
+void sample_lookup_guide_eo_n_r(struct rr_state *s, struct lookup_guide_s *x, u32 *out, u64 count) {
+    // Hoist the table and keep the recycled state in registers;
+    // the output is identical to count calls of sample_lookup_guide_eo_r.
+    const struct lookup_guide_s t = *x;
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    for (u64 i = 0; i < count; ++i) {
+        out[i] = sample_lookup_guide_eo_local(s, &state, &bound, &t);
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void sample_lookup_guide_eo_n(struct lookup_guide_s *x, u32 *out, u64 count) {
+    sample_lookup_guide_eo_n_r(&rr_default, x, out, count);
+}
+
+void free_lookup_guide(struct lookup_guide_s x) {
+    table_block_free(x.block);
+}
+
+u64 bytes_lookup_guide(struct lookup_guide_s *x) {
+    u64 bytes[] = {
+        (u64)x->cdf_length * sizeof(x->cdf[0]),
+        (u64)x->guide_length * sizeof(x->guide[0])
+    };
+    return sizeof(*x) + table_block_bytes(2, bytes);
 }
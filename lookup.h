@@ -11,17 +11,57 @@
 #define LOOKUP_H
 
 #include "types.h"
+#include "uniform.h"
 
+// lookup holds the outcome of each of the lookup_length draws, in
+// lookup_width bytes, the index width of cdf_length - 2.
 struct lookup_eo_s {
     u32 cdf_length;
     u32 lookup_length;
+    u32 lookup_width;
+    struct uniform_modulus_s modulus;   // of lookup_length
     u32 *cdf;
-    u32 *lookup;
+    void *lookup;
+    void *block;
 };
 
+// Bytes of lookup, padded so that a 4-byte load at any entry stays in it.
+static inline u64 lookup_eo_array_bytes(u32 lookup_length, u32 lookup_width) {
+    return (u64)lookup_length * lookup_width + sizeof(u32) - lookup_width;
+}
+
 struct lookup_eo_s preprocess_lookup_eo(int* a, int n);
+// Same table, built on num_threads threads (0 for every processor).
+struct lookup_eo_s preprocess_lookup_eo_parallel(int* a, int n, u32 num_threads);
 u32 sample_lookup_eo(struct lookup_eo_s *x);
+u32 sample_lookup_eo_r(struct rr_state *s, struct lookup_eo_s *x);
+void sample_lookup_eo_n(struct lookup_eo_s *x, u32 *out, u64 count);
+void sample_lookup_eo_n_r(struct rr_state *s, struct lookup_eo_s *x, u32 *out, u64 count);
 void free_lookup_eo(struct lookup_eo_s x);
-u32 bytes_lookup_eo(struct lookup_eo_s *x);
+u64 bytes_lookup_eo(struct lookup_eo_s *x);
+
+// Guide table: bucket j of the range [0, m) holds the outcome at the
+// start of the bucket, so a draw needs one table access plus a short
+// scan of the CDF when the bucket spans several outcomes.
+// Memory is O(n + num_buckets) rather than O(m).
+// The total weight m must satisfy 0 < m <= RR_MAX_RANGE; this is
+// checked with assert.
+struct lookup_guide_s {
+    u32 cdf_length;
+    u32 guide_length;
+    u32 shift;
+    struct uniform_modulus_s modulus;   // of cdf[cdf_length - 1]
+    u64 *cdf;
+    u32 *guide;
+    void *block;
+};
+
+struct lookup_guide_s preprocess_lookup_guide(u32* a, u32 n, u32 num_buckets);
+u32 sample_lookup_guide_eo(struct lookup_guide_s *x);
+u32 sample_lookup_guide_eo_r(struct rr_state *s, struct lookup_guide_s *x);
+void sample_lookup_guide_eo_n(struct lookup_guide_s *x, u32 *out, u64 count);
+void sample_lookup_guide_eo_n_r(struct rr_state *s, struct lookup_guide_s *x, u32 *out, u64 count);
+void free_lookup_guide(struct lookup_guide_s x);
+u64 bytes_lookup_guide(struct lookup_guide_s *x);
 
 #endif
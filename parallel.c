@@ -0,0 +1,70 @@
+/*
+  Name:     parallel.c
+  Purpose:  Running preprocessing passes on several threads.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "uniform.h"
+
+struct parallel_task_s {
+    void (*fn)(void *arg, u32 t, u32 num_threads);
+    void *arg;
+    u32 t;
+    u32 num_threads;
+};
+
+static void *parallel_main(void *p) {
+    struct parallel_task_s *task = p;
+    task->fn(task->arg, task->t, task->num_threads);
+    return NULL;
+}
+
+void parallel_run(u32 num_threads, void (*fn)(void *arg, u32 t, u32 num_threads), void *arg) {
+    if (num_threads <= 1) {
+        fn(arg, 0, 1);
+        return;
+    }
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    struct parallel_task_s *tasks = malloc(num_threads * sizeof(struct parallel_task_s));
+    for (u32 t = 0; t < num_threads; ++t) {
+        tasks[t] = (struct parallel_task_s) {
+            .fn = fn,
+            .arg = arg,
+            .t = t,
+            .num_threads = num_threads
+        };
+    }
+    // A thread that fails to start runs on the caller instead.
+    bool *started = calloc(num_threads, sizeof(bool));
+    for (u32 t = 1; t < num_threads; ++t) {
+        started[t] = pthread_create(&threads[t], NULL, parallel_main, &tasks[t]) == 0;
+    }
+    parallel_main(&tasks[0]);
+    for (u32 t = 1; t < num_threads; ++t) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        } else {
+            parallel_main(&tasks[t]);
+        }
+    }
+    free(started);
+    free(tasks);
+    free(threads);
+}
+
+u32 parallel_threads(u32 num_threads, u64 n) {
+    if (num_threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = online > 0 ? online : 1;
+    }
+    u64 most = n / PARALLEL_GRAIN;
+    return max((u64)1, min((u64)num_threads, most));
+}
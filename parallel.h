@@ -0,0 +1,33 @@
+/*
+  Name:     parallel.h
+  Purpose:  Running preprocessing passes on several threads.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "types.h"
+
+// Run fn(arg, t, num_threads) for t = 0, ..., num_threads-1, each on its
+// own thread (t = 0 on the caller's), and wait for all of them.
+void parallel_run(u32 num_threads, void (*fn)(void *arg, u32 t, u32 num_threads), void *arg);
+
+// Split [0, n) into num_threads contiguous ranges; thread t gets
+// [begin, end). The split depends only on n, t and num_threads.
+static inline void parallel_range(u64 n, u32 t, u32 num_threads, u64 *begin, u64 *end) {
+    *begin = (u128)n * t / num_threads;
+    *end = (u128)n * (t + 1) / num_threads;
+}
+
+// Minimum number of items given to each thread.
+#define PARALLEL_GRAIN (1u << 16)
+
+// Threads to use for n items: num_threads, or every online processor
+// when num_threads is 0, and never fewer than PARALLEL_GRAIN items each.
+u32 parallel_threads(u32 num_threads, u64 n);
+
+#endif
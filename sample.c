@@ -7,94 +7,726 @@
   Released under Apache 2.0; refer to LICENSE.txt
 */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "types.h"
+#include "source.h"
 #include "uniform.h"
 #include "aldr.h"
 #include "alias.h"
 #include "lookup.h"
 #include "binarysearch.h"
+#include "counts.h"
+#include "parallel.h"
 
-#define SAMPLE_PRINT(key, \
+// Samples drawn by each thread per round; the caller writes the rounds
+// in order, so thread t produces chunk c = k*T + t of round k, that is
+// samples c * SAMPLE_CHUNK, .... With --seed, chunk c is drawn from its
+// own source seeded with S + c, so the output only depends on the seed
+// and not on the threads.
+#define SAMPLE_CHUNK (1u << 16)
+
+// Longest text encoding of one sample: 10 digits and a space.
+#define TEXT_BYTES 11
+
+enum sample_format {
+    FORMAT_TEXT,
+    FORMAT_U8,
+    FORMAT_U16,
+    FORMAT_U32,
+};
+
+// Samplers behind a common interface, so that threads can share them;
+// the 64 functions take 64-bit weights, and are NULL when unsupported.
+struct sampler_s {
+    const char *key;
+    void *(*preprocess)(u32 *a, u32 n, u32 num_threads);
+    void (*sample_n)(struct rr_state *s, void *x, u32 *out, u64 count);
+    void (*free)(void *x);
+    void *(*preprocess64)(u64 *a, u32 n, u32 num_threads);
+    void (*sample64_n)(struct rr_state *s, void *x, u32 *out, u64 count);
+    void (*free64)(void *x);
+};
+
+#define SAMPLER(name, \
         struct_name, \
         func_preprocess, \
-        func_sample, \
+        func_sample_n, \
         func_free) \
-    if(strcmp(var_sampler, key) == 0) { \
-        struct struct_name s = func_preprocess(a, n); \
-        for (u32 i = 0; i < num_samples; ++i) { \
-            printf("%d ", func_sample(&s)); \
-        } \
-        printf("\n"); \
-        func_free(s); \
+    static void *name##_preprocess(u32 *a, u32 n, u32 num_threads) { \
+        struct struct_name *x = malloc(sizeof(*x)); \
+        *x = func_preprocess((void *)a, n, num_threads); \
+        return x; \
+    } \
+    static void name##_sample_n(struct rr_state *s, void *x, u32 *out, u64 count) { \
+        func_sample_n(s, x, out, count); \
+    } \
+    static void name##_free(void *x) { \
+        func_free(*(struct struct_name *)x); \
+        free(x); \
+    }
+
+// Tables of 64-bit weights are built on one thread.
+#define SAMPLER64(name, \
+        struct_name, \
+        func_preprocess, \
+        func_sample_n, \
+        func_free) \
+    static void *name##_preprocess(u64 *a, u32 n, u32 num_threads) { \
+        (void)num_threads; \
+        struct struct_name *x = malloc(sizeof(*x)); \
+        *x = func_preprocess(a, n); \
+        return x; \
+    } \
+    static void name##_sample_n(struct rr_state *s, void *x, u32 *out, u64 count) { \
+        func_sample_n(s, x, out, count); \
+    } \
+    static void name##_free(void *x) { \
+        func_free(*(struct struct_name *)x); \
+        free(x); \
+    }
+
+SAMPLER(cdf,
+    array_s,
+    preprocess_cdf_parallel,
+    sample_cdf_eo_n_r,
+    free_array)
+SAMPLER(lookup,
+    lookup_eo_s,
+    preprocess_lookup_eo_parallel,
+    sample_lookup_eo_n_r,
+    free_lookup_eo)
+SAMPLER(alias,
+    weighted_alias_eo_s,
+    preprocess_weighted_alias_eo_parallel,
+    sample_weighted_alias_eo_n_r,
+    free_weighted_alias_eo)
+SAMPLER(fldr,
+    fldr_eo_s,
+    preprocess_fldr_eo_parallel,
+    sample_fldr_eo_n_r,
+    free_fldr_eo)
+SAMPLER(aldr,
+    aldr_recycle_s,
+    preprocess_aldr_recycle_parallel,
+    sample_aldr_recycle_n_r,
+    free_aldr_recycle)
+SAMPLER64(cdf64,
+    array64_s,
+    preprocess_cdf64,
+    sample_cdf64_eo_n_r,
+    free_array64)
+SAMPLER64(alias64,
+    weighted_alias64_eo_s,
+    preprocess_weighted_alias64_eo,
+    sample_weighted_alias64_eo_n_r,
+    free_weighted_alias64_eo)
+SAMPLER64(fldr64,
+    fldr64_eo_s,
+    preprocess_fldr64_eo,
+    sample_fldr64_eo_n_r,
+    free_fldr64_eo)
+SAMPLER64(aldr64,
+    aldr64_recycle_s,
+    preprocess_aldr64_recycle,
+    sample_aldr64_recycle_n_r,
+    free_aldr64_recycle)
+
+// For uniform, the table is just the number of outcomes.
+static void *uniform_outcomes_preprocess(u32 *a, u32 n, u32 num_threads) {
+    (void)n;
+    (void)num_threads;
+    u64 *x = malloc(sizeof(*x));
+    *x = a[0];
+    return x;
+}
+
+static void *uniform_outcomes_preprocess64(u64 *a, u32 n, u32 num_threads) {
+    (void)n;
+    (void)num_threads;
+    u64 *x = malloc(sizeof(*x));
+    *x = a[0];
+    return x;
+}
+
+static void uniform_outcomes_sample_n(struct rr_state *s, void *x, u32 *out, u64 count) {
+    u64 m = *(u64 *)x;
+    for (u64 i = 0; i < count; ++i) {
+        out[i] = uniform_eo_r(s, m);
+    }
+}
+
+static void uniform_outcomes_free(void *x) {
+    free(x);
+}
+
+static const struct sampler_s samplers[] = {
+    { "uniform", uniform_outcomes_preprocess, uniform_outcomes_sample_n, uniform_outcomes_free,
+        uniform_outcomes_preprocess64, uniform_outcomes_sample_n, uniform_outcomes_free },
+    { "cdf", cdf_preprocess, cdf_sample_n, cdf_free,
+        cdf64_preprocess, cdf64_sample_n, cdf64_free },
+    { "lookup", lookup_preprocess, lookup_sample_n, lookup_free,
+        NULL, NULL, NULL },
+    { "alias", alias_preprocess, alias_sample_n, alias_free,
+        alias64_preprocess, alias64_sample_n, alias64_free },
+    { "fldr", fldr_preprocess, fldr_sample_n, fldr_free,
+        fldr64_preprocess, fldr64_sample_n, fldr64_free },
+    { "aldr", aldr_preprocess, aldr_sample_n, aldr_free,
+        aldr64_preprocess, aldr64_sample_n, aldr64_free },
+};
+
+// Weights of the distribution: a, or a64 for 64-bit weights. They point
+// into the argument list, a read-only mapping of the weights file, or a
+// buffer holding the parsed weights.
+struct weights_s {
+    u32 n;
+    u32 *a;
+    u64 *a64;
+    void *map;
+    u64 map_size;
+    void *buffer;
+};
+
+enum weights_format {
+    WEIGHTS_TEXT,
+    WEIGHTS_U32,
+    WEIGHTS_U64,
+};
+
+static void free_weights(struct weights_s *w) {
+    if (w->map != NULL) {
+        munmap(w->map, w->map_size);
+    }
+    free(w->buffer);
+}
+
+// Map path ("-" for standard input) read-only when it is a regular file,
+// and read it into a buffer otherwise. Return 0 on error.
+static bool load_input(const char *path, void **data, u64 *size, bool *mapped) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (fd != STDIN_FILENO) close(fd);
+        if (base == MAP_FAILED) {
+            return 0;
+        }
+        madvise(base, st.st_size, MADV_SEQUENTIAL);
+        *data = base;
+        *size = st.st_size;
+        *mapped = 1;
+        return 1;
+    }
+    u64 capacity = 1 << 20;
+    u64 length = 0;
+    char *buffer = malloc(capacity);
+    for (;;) {
+        if (length == capacity) {
+            capacity *= 2;
+            buffer = realloc(buffer, capacity);
+        }
+        ssize_t k = read(fd, buffer + length, capacity - length);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) {
+            if (fd != STDIN_FILENO) close(fd);
+            if (k < 0) {
+                free(buffer);
+                return 0;
+            }
+            break;
+        }
+        length += k;
+    }
+    *data = buffer;
+    *size = length;
+    *mapped = 0;
+    return 1;
+}
+
+// Parse whitespace-separated decimal weights into u64, then narrow them
+// in place to u32 if they all fit.
+static bool parse_weights_text(const char *text, u64 size, struct weights_s *w) {
+    u64 capacity = size / 2 + 1;
+    u64 *a64 = malloc(capacity * sizeof(u64));
+    u64 n = 0;
+    u64 largest = 0;
+    const char *p = text;
+    const char *end = text + size;
+    for (;;) {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+            ++p;
+        }
+        if (p == end) {
+            break;
+        }
+        if (*p < '0' || *p > '9') {
+            free(a64);
+            return 0;
+        }
+        u64 x = 0;
+        for (; p < end && '0' <= *p && *p <= '9'; ++p) {
+            if (x > (UINT64_MAX - 9) / 10) {
+                free(a64);
+                return 0;
+            }
+            x = 10 * x + (*p - '0');
+        }
+        a64[n++] = x;
+        largest = max(largest, x);
+    }
+    if (n == 0 || n > UINT32_MAX) {
+        free(a64);
+        return 0;
+    }
+    w->n = n;
+    w->buffer = a64;
+    if (largest <= UINT32_MAX) {
+        // Element i of a is written after element i of a64 is read.
+        u32 *a = (u32 *)a64;
+        for (u64 i = 0; i < n; ++i) {
+            a[i] = a64[i];
+        }
+        w->a = a;
+    } else {
+        w->a64 = a64;
+    }
+    return 1;
+}
+
+// Load the weights of path in format. Binary weights are used in place,
+// without a copy, when path is a regular file.
+static bool load_weights(const char *path, enum weights_format format, struct weights_s *w) {
+    void *data;
+    u64 size;
+    bool mapped;
+    if (!load_input(path, &data, &size, &mapped)) {
+        return 0;
+    }
+    if (format == WEIGHTS_TEXT) {
+        bool ok = parse_weights_text(data, size, w);
+        if (mapped) {
+            munmap(data, size);
+        } else {
+            free(data);
+        }
+        return ok;
+    }
+    u64 width = format == WEIGHTS_U32 ? sizeof(u32) : sizeof(u64);
+    if (mapped) {
+        w->map = data;
+        w->map_size = size;
+    } else {
+        w->buffer = data;
+    }
+    if (size == 0 || size % width != 0 || size / width > UINT32_MAX) {
+        return 0;
+    }
+    w->n = size / width;
+    if (format == WEIGHTS_U32) {
+        w->a = data;
+    } else {
+        w->a64 = data;
+    }
+    return 1;
+}
+
+// Write all of buffer to fd, retrying short and interrupted writes.
+static bool write_all(int fd, const char *buffer, u64 size) {
+    while (size > 0) {
+        ssize_t k = write(fd, buffer, size);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        buffer += k;
+        size -= k;
+    }
+    return 1;
+}
+
+// Encode samples in format; return the number of bytes written to buffer.
+static u64 encode_samples(enum sample_format format, const u32 *samples, u64 count, char *buffer) {
+    unsigned char *p = (unsigned char *)buffer;
+    switch (format) {
+    case FORMAT_U8:
+        for (u64 i = 0; i < count; ++i) {
+            *p++ = samples[i];
+        }
+        break;
+    case FORMAT_U16:
+        for (u64 i = 0; i < count; ++i) {
+            *p++ = samples[i];
+            *p++ = samples[i] >> 8;
+        }
+        break;
+    case FORMAT_U32:
+        for (u64 i = 0; i < count; ++i) {
+            *p++ = samples[i];
+            *p++ = samples[i] >> 8;
+            *p++ = samples[i] >> 16;
+            *p++ = samples[i] >> 24;
+        }
+        break;
+    case FORMAT_TEXT:
+        for (u64 i = 0; i < count; ++i) {
+            char digits[10];
+            u32 k = 0;
+            u32 x = samples[i];
+            do {
+                digits[k++] = '0' + x % 10;
+                x /= 10;
+            } while (x);
+            while (k) {
+                *p++ = digits[--k];
+            }
+            *p++ = ' ';
+        }
+        break;
+    }
+    return p - (unsigned char *)buffer;
+}
+
+struct sample_run_s {
+    void (*sample_n)(struct rr_state *s, void *x, u32 *out, u64 count);
+    void *table;
+    enum sample_format format;
+    u64 num_samples;
+    u64 round;
+    bool seeded;
+    u64 seed;
+    struct rr_state *states;
+    u32 *samples;       // SAMPLE_CHUNK per thread
+    char *buffers;      // SAMPLE_CHUNK * TEXT_BYTES per thread
+    u64 *sizes;
+};
+
+static void sample_round(void *p, u32 t, u32 num_threads) {
+    struct sample_run_s *r = p;
+    u64 begin = (r->round * num_threads + t) * (u64)SAMPLE_CHUNK;
+    u64 count = begin < r->num_samples ? min((u64)SAMPLE_CHUNK, r->num_samples - begin) : 0;
+    u32 *samples = r->samples + (u64)t * SAMPLE_CHUNK;
+    char *buffer = r->buffers + (u64)t * SAMPLE_CHUNK * TEXT_BYTES;
+    if (r->seeded) {
+        rr_state_init(&r->states[t], source_new_seeded(SOURCE_XOSHIRO256,
+            r->seed + begin / SAMPLE_CHUNK));
+    }
+    r->sample_n(&r->states[t], r->table, samples, count);
+    r->sizes[t] = encode_samples(r->format, samples, count, buffer);
+}
+
+// Generate the samples round by round, writing each thread's region of
+// the round in order.
+static bool write_samples(int fd, enum sample_format format, const struct sampler_s *sampler,
+        const struct weights_s *w, u64 num_samples, u32 num_threads, struct rr_state *states,
+        bool seeded, u64 seed) {
+    struct sample_run_s r = {
+        .sample_n = w->a64 ? sampler->sample64_n : sampler->sample_n,
+        .table = w->a64
+            ? sampler->preprocess64(w->a64, w->n, num_threads)
+            : sampler->preprocess(w->a, w->n, num_threads),
+        .format = format,
+        .num_samples = num_samples,
+        .seeded = seeded,
+        .seed = seed,
+        .states = states,
+        .samples = malloc((u64)num_threads * SAMPLE_CHUNK * sizeof(u32)),
+        .buffers = malloc((u64)num_threads * SAMPLE_CHUNK * TEXT_BYTES),
+        .sizes = malloc(num_threads * sizeof(u64))
+    };
+    bool ok = 1;
+    u64 num_rounds = (num_samples + (u64)num_threads * SAMPLE_CHUNK - 1)
+        / ((u64)num_threads * SAMPLE_CHUNK);
+    for (r.round = 0; ok && r.round < num_rounds; ++r.round) {
+        parallel_run(num_threads, sample_round, &r);
+        for (u32 t = 0; ok && t < num_threads; ++t) {
+            u64 begin = (r.round * num_threads + t) * (u64)SAMPLE_CHUNK;
+            if (begin < num_samples) {
+                ok = write_all(fd, r.buffers + (u64)t * SAMPLE_CHUNK * TEXT_BYTES, r.sizes[t]);
+            }
+        }
+    }
+    if (ok && format == FORMAT_TEXT) {
+        ok = write_all(fd, "\n", 1);
+    }
+    if (w->a64) {
+        sampler->free64(r.table);
+    } else {
+        sampler->free(r.table);
+    }
+    free(r.samples);
+    free(r.buffers);
+    free(r.sizes);
+    return ok;
+}
+
+struct counts_run_s {
+    struct array_s cdf;
+    struct array64_s cdf64;
+    u32 n;
+    u64 num_samples;
+    struct rr_state *states;
+    u64 *counts;        // n per thread
+};
+
+static void counts_part(void *p, u32 t, u32 num_threads) {
+    struct counts_run_s *r = p;
+    u64 begin, end;
+    parallel_range(r->num_samples, t, num_threads, &begin, &end);
+    u64 *counts = r->counts + (u64)t * r->n;
+    if (r->cdf64.a) {
+        sample_counts64_r(&r->states[t], &r->cdf64, end - begin, counts);
+    } else {
+        sample_counts_r(&r->states[t], &r->cdf, end - begin, counts);
+    }
+}
+
+// Count the samples of each outcome without drawing them: each thread
+// counts its share of the samples, and the counts are summed.
+// Text counts are separated by spaces; binary counts are u64.
+static bool write_counts(int fd, enum sample_format format, const struct sampler_s *sampler,
+        const struct weights_s *w, u64 num_samples, u32 num_threads, struct rr_state *states) {
+    u32 n = w->n;
+    u32 *weights = w->a;
+    if (strcmp(sampler->key, "uniform") == 0) {
+        n = w->a64 ? w->a64[0] : w->a[0];
+        weights = malloc(n * sizeof(u32));
+        for (u32 i = 0; i < n; ++i) {
+            weights[i] = 1;
+        }
+    }
+    struct counts_run_s r = {
+        .n = n,
+        .num_samples = num_samples,
+        .states = states,
+        .counts = malloc((u64)num_threads * n * sizeof(u64))
+    };
+    if (weights == NULL) {
+        r.cdf64 = preprocess_cdf64(w->a64, n);
+    } else {
+        r.cdf = preprocess_cdf_parallel((int *)weights, n, num_threads);
+    }
+    parallel_run(num_threads, counts_part, &r);
+    for (u32 t = 1; t < num_threads; ++t) {
+        for (u32 i = 0; i < n; ++i) {
+            r.counts[i] += r.counts[(u64)t * n + i];
+        }
+    }
+    char *buffer = malloc((u64)n * 21 + 1);
+    char *p = buffer;
+    for (u32 i = 0; i < n; ++i) {
+        if (format == FORMAT_TEXT) {
+            p += sprintf(p, "%lu ", r.counts[i]);
+        } else {
+            for (u32 b = 0; b < 8; ++b) {
+                *p++ = r.counts[i] >> (8 * b);
+            }
+        }
+    }
+    if (format == FORMAT_TEXT) {
+        *p++ = '\n';
     }
+    bool ok = write_all(fd, buffer, p - buffer);
+    free(buffer);
+    free(r.counts);
+    if (r.cdf64.a) {
+        free_array64(r.cdf64);
+    } else {
+        free_array(r.cdf);
+    }
+    if (weights != w->a) {
+        free(weights);
+    }
+    return ok;
+}
+
+static void usage(const char *name) {
+    printf("usage: %s [options] <sampler> <num_samples> [distribution]\n", name);
+    printf("<sampler>        one of: uniform, cdf, lookup, alias, fldr, aldr\n");
+    printf("<num_samples>    number of samples to generate\n");
+    printf("<distribution>   space-separated list of positive integers (e.g., 5 5 1);\n");
+    printf("                 for uniform, only the first number is used;\n");
+    printf("                 omitted with --weights-file\n\n");
+    printf("options:\n");
+    printf("  --format F     text (default), u8, u16, u32, or binary for the\n");
+    printf("                 narrowest of u8, u16, u32 that fits the outcomes;\n");
+    printf("                 binary formats are little-endian without separators\n");
+    printf("  --output FILE  write to FILE instead of standard output\n");
+    printf("  --threads N    sample on N threads (0 for every processor; default 1)\n");
+    printf("  --seed S       draw deterministically from S; the samples, but not\n");
+    printf("                 the counts, are the same for any number of threads\n");
+    printf("  --counts       write the number of samples of each outcome instead\n");
+    printf("                 of the samples, without drawing them; text counts\n");
+    printf("                 are separated by spaces, binary counts are u64\n");
+    printf("  --weights-file PATH\n");
+    printf("                 read the distribution from PATH (- for standard input)\n");
+    printf("  --weights-format F\n");
+    printf("                 text (default): whitespace-separated integers;\n");
+    printf("                 u32, u64: raw native-endian integers, used in place\n\n");
+    printf("examples:\n");
+    printf("  %s uniform 100 17\n", name);
+    printf("  %s cdf 10 5 5 1\n", name);
+    printf("  %s --format binary --threads 4 --seed 1 --output x.bin alias 100000000 5 5 1\n", name);
+    printf("  %s --counts cdf 1000000000 5 5 1\n", name);
+    printf("  %s --weights-file weights.bin --weights-format u32 aldr 1000\n", name);
+}
 
 int main(int argc, char **argv) {
-    if (argc < 4) {
-        printf("usage: %s <sampler> <num_samples> <distribution>\n", argv[0]);
-        printf("<sampler>        one of: uniform, cdf, lookup, alias, fldr, aldr\n");
-        printf("<num_samples>    number of samples to generate\n");
-        printf("<distribution>   space-separated list of positive integers (e.g., 5 5 1);\n");
-        printf("                 for uniform, only the first number is used\n\n");
-        printf("examples:\n");
-        printf("  %s uniform 100 17\n", argv[0]);
-        printf("  %s cdf 10 5 5 1\n", argv[0]);
+    enum sample_format format = FORMAT_TEXT;
+    bool narrowest = 0;
+    const char *output = NULL;
+    u32 num_threads = 1;
+    bool seeded = 0;
+    u64 seed = 0;
+    bool counts = 0;
+    const char *weights_file = NULL;
+    enum weights_format weights_format = WEIGHTS_TEXT;
+
+    // Parse the options.
+    int arg = 1;
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; ++arg) {
+        const char *option = argv[arg];
+        if (strcmp(option, "--counts") == 0) {
+            counts = 1;
+            continue;
+        }
+        if (arg + 1 == argc) {
+            break;
+        }
+        const char *value = argv[++arg];
+        if (strcmp(option, "--format") == 0) {
+            if (strcmp(value, "text") == 0) format = FORMAT_TEXT;
+            else if (strcmp(value, "u8") == 0) format = FORMAT_U8;
+            else if (strcmp(value, "u16") == 0) format = FORMAT_U16;
+            else if (strcmp(value, "u32") == 0) format = FORMAT_U32;
+            else if (strcmp(value, "binary") == 0) narrowest = 1;
+            else {
+                fprintf(stderr, "unknown format: %s\n", value);
+                return 1;
+            }
+        } else if (strcmp(option, "--output") == 0) {
+            output = value;
+        } else if (strcmp(option, "--threads") == 0) {
+            num_threads = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "--weights-file") == 0) {
+            weights_file = value;
+        } else if (strcmp(option, "--weights-format") == 0) {
+            if (strcmp(value, "text") == 0) weights_format = WEIGHTS_TEXT;
+            else if (strcmp(value, "u32") == 0) weights_format = WEIGHTS_U32;
+            else if (strcmp(value, "u64") == 0) weights_format = WEIGHTS_U64;
+            else {
+                fprintf(stderr, "unknown weights format: %s\n", value);
+                return 1;
+            }
+        } else if (strcmp(option, "--seed") == 0) {
+            seeded = 1;
+            seed = strtoull(value, NULL, 10);
+        } else {
+            fprintf(stderr, "unknown option: %s\n", option);
+            return 1;
+        }
+    }
+    if (argc - arg < (weights_file ? 2 : 3)) {
+        usage(argv[0]);
         exit(0);
     }
-    char *var_sampler = argv[1];
-    u32 num_samples = strtoul(argv[2], NULL, 10);
+    char *var_sampler = argv[arg];
+    u64 num_samples = strtoull(argv[arg + 1], NULL, 10);
+
+    const struct sampler_s *sampler = NULL;
+    for (u32 i = 0; i < sizeof(samplers) / sizeof(samplers[0]); ++i) {
+        if (strcmp(var_sampler, samplers[i].key) == 0) {
+            sampler = &samplers[i];
+        }
+    }
+    if (sampler == NULL) {
+        printf("unknown sampler: %s\n", var_sampler);
+        return 0;
+    }
+
+    if (counts && num_samples > RR_MAX_RANGE) {
+        fprintf(stderr, "--counts takes at most %llu samples\n", RR_MAX_RANGE);
+        return 1;
+    }
 
     // Parse the distribution.
-    u32 n = argc - 3;
-    u32 *a = calloc(n, sizeof(*a));
-    for (u32 i = 0; i < n; ++i) {
-        a[i] = strtoul(argv[i + 3], NULL, 10);
+    struct weights_s w = { 0 };
+    if (weights_file != NULL) {
+        if (!load_weights(weights_file, weights_format, &w)) {
+            fprintf(stderr, "cannot read weights from %s\n", weights_file);
+            free_weights(&w);
+            return 1;
+        }
+    } else {
+        w.n = argc - arg - 2;
+        w.a = w.buffer = calloc(w.n, sizeof(u32));
+        for (u32 i = 0; i < w.n; ++i) {
+            w.a[i] = strtoul(argv[i + arg + 2], NULL, 10);
+        }
+    }
+    if (w.a64 && sampler->preprocess64 == NULL) {
+        fprintf(stderr, "%s takes 32-bit weights\n", var_sampler);
+        free_weights(&w);
+        return 1;
     }
 
-    // Generate uniform samples.
-    if(strcmp("uniform", var_sampler) == 0) {
-        for (u32 i = 0; i < num_samples; ++i) {
-            printf("%ld ", uniform_eo(a[0]));
+    // Check that the outcomes fit the format.
+    u64 num_outcomes = strcmp(var_sampler, "uniform") != 0 ? w.n
+        : w.a64 ? w.a64[0] : w.a[0];
+    if (narrowest) {
+        format = num_outcomes <= (1u << 8) ? FORMAT_U8
+            : num_outcomes <= (1u << 16) ? FORMAT_U16
+            : FORMAT_U32;
+    }
+    if (num_outcomes > (1ull << 32)
+            || (!counts && ((format == FORMAT_U8 && num_outcomes > (1u << 8))
+            || (format == FORMAT_U16 && num_outcomes > (1u << 16))))) {
+        fprintf(stderr, "%lu outcomes do not fit the format\n", num_outcomes);
+        free_weights(&w);
+        return 1;
+    }
+
+    int fd = STDOUT_FILENO;
+    if (output != NULL) {
+        fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror(output);
+            free_weights(&w);
+            return 1;
         }
-        printf("\n");
-        return 0;
     }
 
-    // Generate general samples.
-    SAMPLE_PRINT("cdf",
-        array_s,
-        preprocess_cdf,
-        sample_cdf_eo,
-        free_array)
-    else SAMPLE_PRINT("lookup",
-        lookup_eo_s,
-        preprocess_lookup_eo,
-        sample_lookup_eo,
-        free_lookup_eo)
-    else SAMPLE_PRINT("alias",
-        weighted_alias_eo_s,
-        preprocess_weighted_alias_eo,
-        sample_weighted_alias_eo,
-        free_weighted_alias_eo)
-    else SAMPLE_PRINT("fldr",
-        fldr_eo_s,
-        preprocess_fldr_eo,
-        sample_fldr_eo,
-        free_fldr_eo)
-    else SAMPLE_PRINT("aldr",
-        aldr_recycle_s,
-        preprocess_aldr_recycle,
-        sample_aldr_recycle,
-        free_aldr_recycle)
-    else {
-        printf("unknown sampler: %s\n", var_sampler);
+    // Each thread has its own recycling state; the table is shared.
+    num_threads = parallel_threads(num_threads, num_samples);
+    struct rr_state *states = malloc(num_threads * sizeof(struct rr_state));
+    for (u32 t = 0; t < num_threads; ++t) {
+        rr_state_init(&states[t], seeded
+            ? source_new_seeded(SOURCE_XOSHIRO256, seed + t)
+            : source_new(SOURCE_GETRANDOM));
+    }
+
+    bool ok = counts
+        ? write_counts(fd, format, sampler, &w, num_samples, num_threads, states)
+        : write_samples(fd, format, sampler, &w, num_samples, num_threads, states, seeded, seed);
+    if (!ok) {
+        perror("write");
+    }
+    if (output != NULL) {
+        close(fd);
     }
 
     // Free the heap.
-    free(a);
+    free(states);
+    free_weights(&w);
 
-    return 0;
+    return !ok;
 }
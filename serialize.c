@@ -0,0 +1,463 @@
+/*
+  Name:     serialize.c
+  Purpose:  Saving preprocessed tables and mapping them back from disk.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "serialize.h"
+
+static u64 align_table(u64 offset) {
+    return (offset + TABLE_ALIGN - 1) & ~(u64)(TABLE_ALIGN - 1);
+}
+
+static bool write_padding(FILE *f, u64 n) {
+    static const char zeros[TABLE_ALIGN] = { 0 };
+    return fwrite(zeros, 1, n, f) == n;
+}
+
+static bool save_table(const char *path, enum table_kind kind,
+        const u64 *fields, u32 num_fields,
+        const void **arrays, const u64 *bytes, u32 num_arrays) {
+    struct table_header_s h = { 0 };
+    memcpy(h.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+    h.version = TABLE_VERSION;
+    h.endian = TABLE_ENDIAN;
+    h.kind = kind;
+    h.num_arrays = num_arrays;
+    memcpy(h.fields, fields, num_fields * sizeof(u64));
+    u64 offset = align_table(sizeof(h));
+    for (u32 i = 0; i < num_arrays; ++i) {
+        h.arrays[i].offset = offset;
+        h.arrays[i].bytes = bytes[i];
+        offset = align_table(offset + bytes[i]);
+    }
+    h.file_size = offset;
+
+    // Write beside path and rename, so that processes mapping path
+    // see either the old table or the complete new one.
+    char *tmp = malloc(strlen(path) + 32);
+    sprintf(tmp, "%s.%d.tmp", path, (int)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        free(tmp);
+        return 0;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    u64 pos = sizeof(h);
+    for (u32 i = 0; ok && i < num_arrays; ++i) {
+        ok = write_padding(f, h.arrays[i].offset - pos)
+            && fwrite(arrays[i], 1, bytes[i], f) == bytes[i];
+        pos = h.arrays[i].offset + bytes[i];
+    }
+    ok = ok && write_padding(f, h.file_size - pos);
+    ok = (fclose(f) == 0) && ok;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) {
+        remove(tmp);
+    }
+    free(tmp);
+    return ok;
+}
+
+static const struct table_header_s *load_table(const char *path, enum table_kind kind,
+        u32 num_arrays, struct mapped_table_s *m) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(struct table_header_s)) {
+        close(fd);
+        return NULL;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    const struct table_header_s *h = base;
+    u64 size = st.st_size;
+    bool ok = memcmp(h->magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) == 0
+        && h->version == TABLE_VERSION
+        && h->endian == TABLE_ENDIAN
+        && h->kind == (u32)kind
+        && h->num_arrays == num_arrays
+        && h->file_size == size;
+    for (u32 i = 0; ok && i < num_arrays; ++i) {
+        ok = h->arrays[i].offset % TABLE_ALIGN == 0
+            && h->arrays[i].offset <= size
+            && h->arrays[i].bytes <= size - h->arrays[i].offset;
+    }
+    if (!ok) {
+        munmap(base, size);
+        return NULL;
+    }
+    *m = (struct mapped_table_s) { .base = base, .size = size };
+    return h;
+}
+
+static void *table_array(const struct table_header_s *h, u32 i) {
+    return (char *)h + h->arrays[i].offset;
+}
+
+static bool reject_table(struct mapped_table_s *m) {
+    unmap_table(*m);
+    *m = (struct mapped_table_s) { 0 };
+    return 0;
+}
+
+static bool check_table(const struct table_header_s *h, const u64 *bytes, u32 num_arrays,
+        struct mapped_table_s *m) {
+    // The array sizes must agree with the scalar fields.
+    for (u32 i = 0; i < num_arrays; ++i) {
+        if (h->arrays[i].bytes != bytes[i]) {
+            return reject_table(m);
+        }
+    }
+    return 1;
+}
+
+// The first count fields fill u32 members of the table.
+static bool check_fields_u32(const struct table_header_s *h, u32 count) {
+    for (u32 i = 0; i < count; ++i) {
+        if (h->fields[i] > UINT32_MAX) return 0;
+    }
+    return 1;
+}
+
+// The samplers index the tables with their contents, so a corrupt file
+// must be rejected before use: the checks below take one pass over the
+// arrays and accept exactly the tables that the samplers walk safely.
+
+// A CDF from 0 that never decreases and ends above 0.
+static bool check_cdf(const u32 *cdf, u32 length) {
+    if (length < 2 || cdf[0] != 0 || cdf[length - 1] == 0) return 0;
+    for (u32 i = 1; i < length; ++i) {
+        if (cdf[i] < cdf[i - 1]) return 0;
+    }
+    return 1;
+}
+
+// The tree walk of sample_fldr_eo and sample_aldr_recycle, with
+// num_flips = length_breadths - 1 bits: level d has N_d nodes, the first
+// breadths[d] of them leaves, and 2 * (N_d - breadths[d]) nodes below.
+// The nodes left over at the last level are the largest values of the
+// flips, so every value below 2^num_flips - excess reaches a leaf. A leaf
+// at level d must be an outcome whose weight has bit num_flips - d set,
+// so that the recycled state stays below the weight.
+static bool check_ddg(const u32 *breadths, u32 length_breadths, const void *leaves_flat,
+        u32 leaves_width, u32 length_leaves_flat, const void *weights, u32 weights_width,
+        u32 n, u64 excess) {
+    u32 num_flips = length_breadths - 1;
+    u64 nodes = 1;
+    u64 location = 0;
+    for (u32 depth = 0; depth <= num_flips; ++depth) {
+        u32 breadth = breadths[depth];
+        if (breadth > nodes || location + breadth > length_leaves_flat) return 0;
+        for (u32 val = 0; val < breadth; ++val) {
+            u64 ans = index_get(leaves_flat, leaves_width, location + val);
+            if (ans >= n
+                    || !((index_get(weights, weights_width, ans) >> (num_flips - depth)) & 1)) {
+                return 0;
+            }
+        }
+        location += breadth;
+        if (depth < num_flips) {
+            nodes = 2 * (nodes - breadth);
+        } else {
+            nodes -= breadth;
+        }
+    }
+    return location == length_leaves_flat && nodes == excess;
+}
+
+void unmap_table(struct mapped_table_s m) {
+    if (m.base != NULL) {
+        munmap(m.base, m.size);
+    }
+}
+
+// cdf
+
+bool save_cdf(const char *path, struct array_s *x) {
+    u64 fields[] = { x->length };
+    const void *arrays[] = { x->a };
+    u64 bytes[] = { (u64)x->length * sizeof(x->a[0]) };
+    return save_table(path, TABLE_CDF, fields, 1, arrays, bytes, 1);
+}
+
+bool load_cdf(const char *path, struct array_s *x, struct mapped_table_s *m) {
+    const struct table_header_s *h = load_table(path, TABLE_CDF, 1, m);
+    if (h == NULL) return 0;
+    if (!check_fields_u32(h, 1)) return reject_table(m);
+    struct array_s t = { .length = h->fields[0], .a = table_array(h, 0) };
+    u64 bytes[] = { (u64)t.length * sizeof(t.a[0]) };
+    if (!check_table(h, bytes, 1, m)) return 0;
+    if (!check_cdf(t.a, t.length)) return reject_table(m);
+    t.modulus = uniform_modulus(t.a[t.length - 1]);
+    *x = t;
+    return 1;
+}
+
+// lookup
+
+bool save_lookup_eo(const char *path, struct lookup_eo_s *x) {
+    u64 fields[] = { x->cdf_length, x->lookup_length };
+    const void *arrays[] = { x->cdf, x->lookup };
+    u64 bytes[] = {
+        (u64)x->cdf_length * sizeof(x->cdf[0]),
+        lookup_eo_array_bytes(x->lookup_length, x->lookup_width)
+    };
+    return save_table(path, TABLE_LOOKUP_EO, fields, 2, arrays, bytes, 2);
+}
+
+bool load_lookup_eo(const char *path, struct lookup_eo_s *x, struct mapped_table_s *m) {
+    const struct table_header_s *h = load_table(path, TABLE_LOOKUP_EO, 2, m);
+    if (h == NULL) return 0;
+    // The cdf holds 0 and at least one outcome, and the lookup table
+    // at least one entry per outcome.
+    if (!check_fields_u32(h, 2) || h->fields[0] < 2 || h->fields[1] < 1) {
+        return reject_table(m);
+    }
+    struct lookup_eo_s t = {
+        .cdf_length = h->fields[0],
+        .lookup_length = h->fields[1],
+        .lookup_width = index_width((u32)h->fields[0] - 2),
+        .modulus = uniform_modulus(h->fields[1]),
+        .cdf = table_array(h, 0),
+        .lookup = table_array(h, 1)
+    };
+    u64 bytes[] = {
+        (u64)t.cdf_length * sizeof(t.cdf[0]),
+        lookup_eo_array_bytes(t.lookup_length, t.lookup_width)
+    };
+    if (!check_table(h, bytes, 2, m)) return 0;
+    // Entry u of the lookup table is the outcome i with
+    // cdf[i] <= u < cdf[i+1].
+    if (!check_cdf(t.cdf, t.cdf_length) || t.cdf[t.cdf_length - 1] != t.lookup_length) {
+        return reject_table(m);
+    }
+    u32 outcome = 0;
+    for (u32 u = 0; u < t.lookup_length; ++u) {
+        while (t.cdf[outcome + 1] <= u) {
+            ++outcome;
+        }
+        if (index_get(t.lookup, t.lookup_width, u) != outcome) return reject_table(m);
+    }
+    *x = t;
+    return 1;
+}
+
+// alias
+
+bool save_weighted_alias_eo(const char *path, struct weighted_alias_eo_s *x) {
+    u64 fields[] = { x->length, x->weight_sum };
+    const void *arrays[] = { x->weights, x->aliases, x->no_alias_odds, x->offsets };
+    u64 bytes[] = {
+        (u64)x->length * sizeof(x->weights[0]),
+        (u64)x->length * x->aliases_width,
+        (u64)x->length * x->odds_width,
+        (u64)x->length * x->offsets_width
+    };
+    return save_table(path, TABLE_WEIGHTED_ALIAS_EO, fields, 2, arrays, bytes, 4);
+}
+
+bool load_weighted_alias_eo(const char *path, struct weighted_alias_eo_s *x, struct mapped_table_s *m) {
+    const struct table_header_s *h = load_table(path, TABLE_WEIGHTED_ALIAS_EO, 4, m);
+    if (h == NULL) return 0;
+    if (!check_fields_u32(h, 2)) return reject_table(m);
+    struct weighted_alias_eo_s t = {
+        .length = h->fields[0],
+        .weight_sum = h->fields[1],
+        .weights = table_array(h, 0),
+        .aliases = table_array(h, 1),
+        .no_alias_odds = table_array(h, 2),
+        .offsets = table_array(h, 3)
+    };
+    weighted_alias_eo_widths(&t);
+    u64 bytes[] = {
+        (u64)t.length * sizeof(t.weights[0]),
+        (u64)t.length * t.aliases_width,
+        (u64)t.length * t.odds_width,
+        (u64)t.length * t.offsets_width
+    };
+    if (!check_table(h, bytes, 4, m)) return 0;
+    // Column i keeps uniform weights below its odds for outcome i, and maps
+    // the others through its offset, modulo 2^(8 * offsets_width), into
+    // the range of its alias; each range must lie within the outcome's
+    // weight times the length.
+    u64 length = t.length;
+    u64 weight_sum = t.weight_sum;
+    if (length == 0 || weight_sum == 0 || length * weight_sum > RR_MAX_RANGE) {
+        return reject_table(m);
+    }
+    u64 total = 0;
+    for (u32 i = 0; i < t.length; ++i) {
+        total += t.weights[i];
+    }
+    if (total != weight_sum) return reject_table(m);
+    t.modulus = uniform_modulus(length * weight_sum);
+    t.length_modulus = uniform_modulus(length);
+    u64 offsets_mask = t.offsets_width == sizeof(u32) ? UINT32_MAX : UINT64_MAX;
+    for (u32 i = 0; i < t.length; ++i) {
+        u64 odds = index_get(t.no_alias_odds, t.odds_width, i);
+        if (odds > weight_sum || odds > t.weights[i] * length) return reject_table(m);
+        if (odds == weight_sum) continue;
+        u64 alias = index_get(t.aliases, t.aliases_width, i);
+        u64 offset = index_get(t.offsets, t.offsets_width, i);
+        u64 low = (odds + offset) & offsets_mask;
+        u64 high = (weight_sum - 1 + offset) & offsets_mask;
+        if (alias >= length || low > high || high >= t.weights[alias] * length) {
+            return reject_table(m);
+        }
+    }
+    *x = t;
+    return 1;
+}
+
+// fldr
+
+bool save_fldr_eo(const char *path, struct fldr_eo_s *x) {
+    u64 fields[] = {
+        x->length_breadths,
+        x->length_leaves_flat,
+        x->length_weights,
+        x->uniform_preprocessed.num_outcomes,
+        x->uniform_preprocessed.quotient,
+        x->uniform_preprocessed.not_remainder,
+        x->uniform_preprocessed.inverse
+    };
+    const void *arrays[] = { x->breadths, x->leaves_flat, x->weights };
+    u64 bytes[] = {
+        (u64)x->length_breadths * sizeof(x->breadths[0]),
+        (u64)x->length_leaves_flat * x->leaves_width,
+        (u64)x->length_weights * sizeof(x->weights[0])
+    };
+    return save_table(path, TABLE_FLDR_EO, fields, 7, arrays, bytes, 3);
+}
+
+bool load_fldr_eo(const char *path, struct fldr_eo_s *x, struct mapped_table_s *m) {
+    const struct table_header_s *h = load_table(path, TABLE_FLDR_EO, 3, m);
+    if (h == NULL) return 0;
+    if (!check_fields_u32(h, 6)) return reject_table(m);
+    struct fldr_eo_s t = {
+        .length_breadths = h->fields[0],
+        .length_leaves_flat = h->fields[1],
+        .length_weights = h->fields[2],
+        .leaves_width = index_width((u32)h->fields[2] - 1),
+        .uniform_preprocessed = {
+            .num_outcomes = h->fields[3],
+            .quotient = h->fields[4],
+            .not_remainder = h->fields[5],
+            .inverse = h->fields[6]
+        },
+        .breadths = table_array(h, 0),
+        .leaves_flat = table_array(h, 1),
+        .weights = table_array(h, 2)
+    };
+    u64 bytes[] = {
+        (u64)t.length_breadths * sizeof(t.breadths[0]),
+        (u64)t.length_leaves_flat * t.leaves_width,
+        (u64)t.length_weights * sizeof(t.weights[0])
+    };
+    if (!check_table(h, bytes, 3, m)) return 0;
+    // The flips are uniform below the total weight, in at most 32 bits.
+    u32 num_outcomes = t.uniform_preprocessed.num_outcomes;
+    if (t.length_breadths < 1 || t.length_breadths > 33 || t.length_weights < 1
+            || num_outcomes == 0 || num_outcomes > (1ull << (t.length_breadths - 1))) {
+        return reject_table(m);
+    }
+    struct uniform_preprocessed_s u = uniform_preprocess(num_outcomes);
+    u64 total = 0;
+    for (u32 i = 0; i < t.length_weights; ++i) {
+        total += t.weights[i];
+    }
+    if (u.quotient != t.uniform_preprocessed.quotient
+            || u.not_remainder != t.uniform_preprocessed.not_remainder
+            || u.inverse != t.uniform_preprocessed.inverse
+            || total != num_outcomes
+            || !check_ddg(t.breadths, t.length_breadths, t.leaves_flat, t.leaves_width,
+                t.length_leaves_flat, t.weights, sizeof(u32), t.length_weights,
+                (1ull << (t.length_breadths - 1)) - num_outcomes)) {
+        return reject_table(m);
+    }
+    *x = t;
+    return 1;
+}
+
+// aldr
+
+bool save_aldr_recycle(const char *path, struct aldr_recycle_s *x) {
+    u64 fields[] = {
+        x->length_breadths,
+        x->length_leaves_flat,
+        x->length_weights,
+        x->reject_weight,
+        x->weights_width
+    };
+    const void *arrays[] = { x->breadths, x->leaves_flat, x->weights };
+    u64 bytes[] = {
+        (u64)x->length_breadths * sizeof(x->breadths[0]),
+        (u64)x->length_leaves_flat * x->leaves_width,
+        (u64)x->length_weights * x->weights_width
+    };
+    return save_table(path, TABLE_ALDR_RECYCLE, fields, 5, arrays, bytes, 3);
+}
+
+bool load_aldr_recycle(const char *path, struct aldr_recycle_s *x, struct mapped_table_s *m) {
+    const struct table_header_s *h = load_table(path, TABLE_ALDR_RECYCLE, 3, m);
+    if (h == NULL) return 0;
+    if (!check_fields_u32(h, 4) || (h->fields[4] != sizeof(u32) && h->fields[4] != sizeof(u64))) {
+        return reject_table(m);
+    }
+    struct aldr_recycle_s t = {
+        .length_breadths = h->fields[0],
+        .length_leaves_flat = h->fields[1],
+        .length_weights = h->fields[2],
+        .reject_weight = h->fields[3],
+        .leaves_width = index_width((u32)h->fields[2] - 1),
+        .weights_width = h->fields[4],
+        .breadths = table_array(h, 0),
+        .leaves_flat = table_array(h, 1),
+        .weights = table_array(h, 2)
+    };
+    u64 bytes[] = {
+        (u64)t.length_breadths * sizeof(t.breadths[0]),
+        (u64)t.length_leaves_flat * t.leaves_width,
+        (u64)t.length_weights * t.weights_width
+    };
+    if (!check_table(h, bytes, 3, m)) return 0;
+    // The flips are uniform below 2^num_flips and rejected from
+    // 2^num_flips - reject_weight on, with num_flips at most
+    // RR_MAX_RANGE_BITS; the accepted values are the amplified weights.
+    if (t.length_breadths < 1 || t.length_breadths > RR_MAX_RANGE_BITS + 1
+            || t.length_weights < 1) {
+        return reject_table(m);
+    }
+    u64 range = 1ull << (t.length_breadths - 1);
+    u64 total = 0;
+    for (u32 i = 0; i < t.length_weights; ++i) {
+        u64 weight = index_get(t.weights, t.weights_width, i);
+        if (weight > range - total) return reject_table(m);
+        total += weight;
+    }
+    if (t.reject_weight >= range || total != range - t.reject_weight
+            || !check_ddg(t.breadths, t.length_breadths, t.leaves_flat, t.leaves_width,
+                t.length_leaves_flat, t.weights, t.weights_width, t.length_weights,
+                t.reject_weight)) {
+        return reject_table(m);
+    }
+    *x = t;
+    return 1;
+}
@@ -0,0 +1,84 @@
+/*
+  Name:     serialize.h
+  Purpose:  Saving preprocessed tables and mapping them back from disk.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include "aldr.h"
+#include "arena.h"
+#include "alias.h"
+#include "lookup.h"
+#include "types.h"
+
+// File layout, in native byte order:
+//   struct table_header_s, padded to TABLE_ALIGN bytes;
+//   each array of the table, starting at a multiple of TABLE_ALIGN.
+// The endian tag reads as TABLE_ENDIAN only on a machine with the
+// byte order of the writer, so other machines reject the file.
+#define TABLE_MAGIC "RRTABLE"
+#define TABLE_VERSION 2
+#define TABLE_ENDIAN 0x01020304u
+#define TABLE_MAX_FIELDS 8
+#define TABLE_MAX_ARRAYS 8
+
+enum table_kind {
+    TABLE_CDF = 1,
+    TABLE_LOOKUP_EO,
+    TABLE_WEIGHTED_ALIAS_EO,
+    TABLE_FLDR_EO,
+    TABLE_ALDR_RECYCLE,
+};
+
+struct table_header_s {
+    char magic[8];
+    u32 version;
+    u32 endian;
+    u32 kind;
+    u32 num_arrays;
+    u64 file_size;
+    u64 fields[TABLE_MAX_FIELDS];
+    struct {
+        u64 offset;
+        u64 bytes;
+    } arrays[TABLE_MAX_ARRAYS];
+};
+
+// A read-only shared mapping of a table file. Tables loaded from it
+// point into the mapping: they must not be passed to free_*, and are
+// valid until unmap_table.
+struct mapped_table_s {
+    void *base;
+    u64 size;
+};
+
+void unmap_table(struct mapped_table_s m);
+
+// save_* return 1 on success. The file is written beside path and
+// renamed over it, so readers never see a partial table.
+// load_* return 1 on success, and 0 if the file is missing, truncated,
+// of another kind, version or byte order, or if its contents could not
+// have come from save_*. The contents are checked in one pass over the
+// arrays, so a corrupt file is rejected rather than sampled out of bounds.
+
+bool save_cdf(const char *path, struct array_s *x);
+bool load_cdf(const char *path, struct array_s *x, struct mapped_table_s *m);
+
+bool save_lookup_eo(const char *path, struct lookup_eo_s *x);
+bool load_lookup_eo(const char *path, struct lookup_eo_s *x, struct mapped_table_s *m);
+
+bool save_weighted_alias_eo(const char *path, struct weighted_alias_eo_s *x);
+bool load_weighted_alias_eo(const char *path, struct weighted_alias_eo_s *x, struct mapped_table_s *m);
+
+bool save_fldr_eo(const char *path, struct fldr_eo_s *x);
+bool load_fldr_eo(const char *path, struct fldr_eo_s *x, struct mapped_table_s *m);
+
+bool save_aldr_recycle(const char *path, struct aldr_recycle_s *x);
+bool load_aldr_recycle(const char *path, struct aldr_recycle_s *x, struct mapped_table_s *m);
+
+#endif
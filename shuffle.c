@@ -0,0 +1,118 @@
+/*
+  Name:     shuffle.c
+  Purpose:  Random shuffles and permutations with randomness recycling.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <assert.h>
+#include <string.h>
+
+#include "shuffle.h"
+#include "uniform.h"
+
+// Steps whose indices are drawn, and swaps prefetched, together.
+#define SHUFFLE_BLOCK 64
+
+static inline void shuffle_indices_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        u64 top, u32 count, u64 *j) {
+    // Draw j[t] ~ unif[0, top - t] for t < count, with top - count >= 1.
+    // u ~ unif[0, b_0 b_1 ... b_(k-1)) for the bounds b_q = top - t - q + 1
+    // splits into independent digits u % b_0, (u / b_0) % b_1, ...
+    u32 t = 0;
+    while (t < count) {
+        u64 first = top - t + 1;
+        u64 product = first;
+        u32 k = 1;
+        while (t + k < count && (u128)product * (first - k) <= RR_MAX_RANGE) {
+            product *= first - k;
+            ++k;
+        }
+        u64 u = uniform_eo_local(s, state, bound, product);
+        for (u32 q = 0; q + 1 < k; ++q) {
+            j[t + q] = u % (first - q);
+            u /= first - q;
+        }
+        j[t + k - 1] = u;
+        t += k;
+    }
+}
+
+static inline void swap_elements(char *x, char *y, u64 elem_size) {
+    // Copy through temporaries, as x and y may be the same element.
+    if (elem_size == sizeof(u32)) {
+        u32 a, b;
+        memcpy(&a, x, sizeof(a));
+        memcpy(&b, y, sizeof(b));
+        memcpy(x, &b, sizeof(b));
+        memcpy(y, &a, sizeof(a));
+        return;
+    }
+    if (elem_size == sizeof(u64)) {
+        u64 a, b;
+        memcpy(&a, x, sizeof(a));
+        memcpy(&b, y, sizeof(b));
+        memcpy(x, &b, sizeof(b));
+        memcpy(y, &a, sizeof(a));
+        return;
+    }
+    char a[64], b[64];
+    for (u64 offset = 0; offset < elem_size; offset += sizeof(a)) {
+        u64 length = min(elem_size - offset, (u64)sizeof(a));
+        memcpy(a, x + offset, length);
+        memcpy(b, y + offset, length);
+        memcpy(x + offset, b, length);
+        memcpy(y + offset, a, length);
+    }
+}
+
+static inline void shuffle_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        char *array, u64 n, u64 elem_size) {
+    u64 j[SHUFFLE_BLOCK];
+    for (u64 i = n - 1; i > 0;) {
+        u32 count = min(i, (u64)SHUFFLE_BLOCK);
+        shuffle_indices_local(s, state, bound, i, count, j);
+        for (u32 t = 0; t < count; ++t) {
+            __builtin_prefetch(array + j[t] * elem_size, 1);
+        }
+        for (u32 t = 0; t < count; ++t, --i) {
+            swap_elements(array + i * elem_size, array + j[t] * elem_size, elem_size);
+        }
+    }
+}
+
+void shuffle_eo_r(struct rr_state *s, void *array, u64 n, u64 elem_size) {
+    assert(n <= RR_MAX_RANGE);
+    if (n < 2) {
+        return;
+    }
+    rr_uint state = s->unif_state;
+    rr_uint bound = s->unif_bound;
+    // Specialize the swaps of 4- and 8-byte elements.
+    if (elem_size == sizeof(u32)) {
+        shuffle_local(s, &state, &bound, array, n, sizeof(u32));
+    } else if (elem_size == sizeof(u64)) {
+        shuffle_local(s, &state, &bound, array, n, sizeof(u64));
+    } else {
+        shuffle_local(s, &state, &bound, array, n, elem_size);
+    }
+    s->unif_state = state;
+    s->unif_bound = bound;
+}
+
+void shuffle_eo(void *array, u64 n, u64 elem_size) {
+    shuffle_eo_r(&rr_default, array, n, elem_size);
+}
+
+void random_permutation_eo_r(struct rr_state *s, u32 *out, u32 n) {
+    for (u32 i = 0; i < n; ++i) {
+        out[i] = i;
+    }
+    shuffle_eo_r(s, out, n, sizeof(u32));
+}
+
+void random_permutation_eo(u32 *out, u32 n) {
+    random_permutation_eo_r(&rr_default, out, n);
+}
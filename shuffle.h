@@ -0,0 +1,29 @@
+/*
+  Name:     shuffle.h
+  Purpose:  Random shuffles and permutations with randomness recycling.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#ifndef SHUFFLE_H
+#define SHUFFLE_H
+
+#include "types.h"
+#include "uniform.h"
+
+// Fisher-Yates shuffle of n elements of elem_size bytes, for
+// n <= RR_MAX_RANGE. The indices of consecutive steps, uniform in
+// [0, i], [0, i-1], ..., are the mixed-radix digits of one uniform_eo
+// draw in [0, (i+1) i ...), with as many factors as fit in RR_MAX_RANGE.
+// The indices of a block of steps are drawn before its swaps, so that
+// the swaps of the block can be prefetched.
+void shuffle_eo(void *array, u64 n, u64 elem_size);
+void shuffle_eo_r(struct rr_state *s, void *array, u64 n, u64 elem_size);
+
+// out[0], ..., out[n-1] is a uniformly random permutation of 0, ..., n-1.
+void random_permutation_eo(u32 *out, u32 n);
+void random_permutation_eo_r(struct rr_state *s, u32 *out, u32 n);
+
+#endif
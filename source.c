@@ -0,0 +1,267 @@
+/*
+  Name:     source.c
+  Purpose:  Sources of uniform random bits.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOURCE_HAVE_AESNI 1
+#endif
+
+#include "source.h"
+#include "types.h"
+
+static void os_entropy(void *buffer, u64 length) {
+    unsigned char *p = buffer;
+    while (length > 0) {
+        ssize_t got = getrandom(p, length, 0);
+        if (got < 0) {
+            // Retry when interrupted by a signal; any other error leaves
+            // no source of entropy, and the samples must not go on.
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("getrandom");
+            abort();
+        }
+        p += got;
+        length -= got;
+    }
+}
+
+static u64 splitmix64(u64 *x) {
+    u64 z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// getrandom
+
+static void fill_getrandom(struct bit_source_s *source, u64 *buffer, u32 n) {
+    (void)source;
+    os_entropy(buffer, (u64)n * sizeof(buffer[0]));
+}
+
+// xoshiro256**
+
+static inline u64 rotl(u64 x, u32 k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static void fill_xoshiro256(struct bit_source_s *source, u64 *buffer, u32 n) {
+    u64 s0 = source->xoshiro[0];
+    u64 s1 = source->xoshiro[1];
+    u64 s2 = source->xoshiro[2];
+    u64 s3 = source->xoshiro[3];
+    for (u32 i = 0; i < n; ++i) {
+        buffer[i] = rotl(s1 * 5, 7) * 9;
+        u64 t = s1 << 17;
+        s2 ^= s0;
+        s3 ^= s1;
+        s1 ^= s2;
+        s0 ^= s3;
+        s2 ^= t;
+        s3 = rotl(s3, 45);
+    }
+    source->xoshiro[0] = s0;
+    source->xoshiro[1] = s1;
+    source->xoshiro[2] = s2;
+    source->xoshiro[3] = s3;
+}
+
+// ChaCha20, with a 64-bit block counter and zero nonce.
+
+#define CHACHA_QR(a, b, c, d)                       \
+    a += b; d ^= a; d = (d << 16) | (d >> 16);      \
+    c += d; b ^= c; b = (b << 12) | (b >> 20);      \
+    a += b; d ^= a; d = (d << 8) | (d >> 24);       \
+    c += d; b ^= c; b = (b << 7) | (b >> 25);
+
+static void chacha20_block(const u32 key[8], u64 counter, u32 out[16]) {
+    u32 in[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3],
+        key[4], key[5], key[6], key[7],
+        (u32)counter, (u32)(counter >> 32), 0, 0
+    };
+    u32 x[16];
+    memcpy(x, in, sizeof(x));
+    for (u32 i = 0; i < 10; ++i) {
+        CHACHA_QR(x[0], x[4], x[8],  x[12]);
+        CHACHA_QR(x[1], x[5], x[9],  x[13]);
+        CHACHA_QR(x[2], x[6], x[10], x[14]);
+        CHACHA_QR(x[3], x[7], x[11], x[15]);
+        CHACHA_QR(x[0], x[5], x[10], x[15]);
+        CHACHA_QR(x[1], x[6], x[11], x[12]);
+        CHACHA_QR(x[2], x[7], x[8],  x[13]);
+        CHACHA_QR(x[3], x[4], x[9],  x[14]);
+    }
+    for (u32 i = 0; i < 16; ++i) {
+        out[i] = x[i] + in[i];
+    }
+}
+
+static void fill_chacha20(struct bit_source_s *source, u64 *buffer, u32 n) {
+    // Each block yields 8 words.
+    assert(n % 8 == 0);
+    for (u32 i = 0; i < n; i += 8) {
+        chacha20_block(source->chacha.key, source->chacha.counter++, (u32 *)(buffer + i));
+    }
+}
+
+// AES-128 in counter mode.
+
+#ifdef SOURCE_HAVE_AESNI
+
+#define AES_EXPAND(k, rcon)                                               \
+    ({                                                                    \
+        __m128i _t = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(k, rcon), 0xff); \
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 4));                       \
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 4));                       \
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 4));                       \
+        _mm_xor_si128(k, _t);                                             \
+    })
+
+__attribute__((target("aes,sse2")))
+static void aes_expand_key(const u64 key[2], u64 round_keys[22]) {
+    __m128i *rk = (__m128i *)round_keys;
+    __m128i k = _mm_loadu_si128((const __m128i *)key);
+    _mm_storeu_si128(rk + 0, k);
+    k = AES_EXPAND(k, 0x01); _mm_storeu_si128(rk + 1, k);
+    k = AES_EXPAND(k, 0x02); _mm_storeu_si128(rk + 2, k);
+    k = AES_EXPAND(k, 0x04); _mm_storeu_si128(rk + 3, k);
+    k = AES_EXPAND(k, 0x08); _mm_storeu_si128(rk + 4, k);
+    k = AES_EXPAND(k, 0x10); _mm_storeu_si128(rk + 5, k);
+    k = AES_EXPAND(k, 0x20); _mm_storeu_si128(rk + 6, k);
+    k = AES_EXPAND(k, 0x40); _mm_storeu_si128(rk + 7, k);
+    k = AES_EXPAND(k, 0x80); _mm_storeu_si128(rk + 8, k);
+    k = AES_EXPAND(k, 0x1b); _mm_storeu_si128(rk + 9, k);
+    k = AES_EXPAND(k, 0x36); _mm_storeu_si128(rk + 10, k);
+}
+
+__attribute__((target("aes,sse2")))
+static void fill_aesctr(struct bit_source_s *source, u64 *buffer, u32 n) {
+    // Each block yields 2 words; encrypt 4 blocks at a time
+    // to keep the AES units busy.
+    assert(n % 8 == 0);
+    __m128i rk[11];
+    for (u32 r = 0; r < 11; ++r) {
+        rk[r] = _mm_loadu_si128((const __m128i *)source->aes.round_keys + r);
+    }
+    u64 counter = source->aes.counter;
+    for (u32 i = 0; i < n; i += 8) {
+        __m128i b[4];
+        for (u32 j = 0; j < 4; ++j) {
+            b[j] = _mm_xor_si128(_mm_set_epi64x(0, counter + j), rk[0]);
+        }
+        for (u32 r = 1; r < 10; ++r) {
+            for (u32 j = 0; j < 4; ++j) {
+                b[j] = _mm_aesenc_si128(b[j], rk[r]);
+            }
+        }
+        for (u32 j = 0; j < 4; ++j) {
+            _mm_storeu_si128((__m128i *)(buffer + i) + j, _mm_aesenclast_si128(b[j], rk[10]));
+        }
+        counter += 4;
+    }
+    source->aes.counter = counter;
+}
+
+#endif
+
+// replay
+
+static void fill_replay(struct bit_source_s *source, u64 *buffer, u32 n) {
+    for (u32 i = 0; i < n; ++i) {
+        buffer[i] = source->replay.words[source->replay.pos];
+        if (++source->replay.pos == source->replay.length) {
+            source->replay.pos = 0;
+        }
+    }
+}
+
+bool source_available(enum source_kind kind) {
+    switch (kind) {
+    case SOURCE_GETRANDOM:
+    case SOURCE_XOSHIRO256:
+    case SOURCE_CHACHA20:
+    case SOURCE_REPLAY:
+        return 1;
+    case SOURCE_AESCTR:
+#ifdef SOURCE_HAVE_AESNI
+        return __builtin_cpu_supports("aes");
+#else
+        return 0;
+#endif
+    }
+    return 0;
+}
+
+static struct bit_source_s source_from_key(enum source_kind kind, u64 key[4]) {
+    assert(source_available(kind));
+    struct bit_source_s source = { .kind = kind };
+    switch (kind) {
+    case SOURCE_GETRANDOM:
+        source.fill = fill_getrandom;
+        break;
+    case SOURCE_XOSHIRO256:
+        // The all-zero state is a fixed point of xoshiro.
+        if ((key[0] | key[1] | key[2] | key[3]) == 0) key[0] = 1;
+        memcpy(source.xoshiro, key, sizeof(source.xoshiro));
+        source.fill = fill_xoshiro256;
+        break;
+    case SOURCE_CHACHA20:
+        memcpy(source.chacha.key, key, sizeof(source.chacha.key));
+        source.chacha.counter = 0;
+        source.fill = fill_chacha20;
+        break;
+    case SOURCE_AESCTR:
+#ifdef SOURCE_HAVE_AESNI
+        aes_expand_key(key, source.aes.round_keys);
+        source.aes.counter = key[2];
+        source.fill = fill_aesctr;
+#endif
+        break;
+    case SOURCE_REPLAY:
+        // Replay sources are built with source_replay.
+        assert(0);
+    }
+    return source;
+}
+
+struct bit_source_s source_new(enum source_kind kind) {
+    u64 key[4] = { 0 };
+    if (kind != SOURCE_GETRANDOM) {
+        os_entropy(key, sizeof(key));
+    }
+    return source_from_key(kind, key);
+}
+
+struct bit_source_s source_new_seeded(enum source_kind kind, u64 seed) {
+    u64 key[4];
+    for (u32 i = 0; i < 4; ++i) {
+        key[i] = splitmix64(&seed);
+    }
+    return source_from_key(kind, key);
+}
+
+struct bit_source_s source_replay(const u64 *words, u64 length) {
+    assert(length > 0);
+    return (struct bit_source_s) {
+        .kind = SOURCE_REPLAY,
+        .fill = fill_replay,
+        .replay = { .words = words, .length = length, .pos = 0 }
+    };
+}
@@ -0,0 +1,62 @@
+/*
+  Name:     source.h
+  Purpose:  Sources of uniform random bits.
+  Author:   CMU Probabilistic Computing Systems Lab
+  Copyright (C) 2025 CMU Probabilistic Computing Systems Lab, All Rights Reserved.
+
+  Released under Apache 2.0; refer to LICENSE.txt
+*/
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include "types.h"
+
+// Number of 64-bit words requested from a source on each refill.
+// The source is only called through its fill pointer once per
+// SOURCE_BUFFER_WORDS words, never on the per-bit path.
+#define SOURCE_BUFFER_WORDS 512
+
+enum source_kind {
+    SOURCE_GETRANDOM,   // buffered getrandom() pool
+    SOURCE_XOSHIRO256,  // xoshiro256**
+    SOURCE_CHACHA20,    // ChaCha20 keystream
+    SOURCE_AESCTR,      // AES-128 in counter mode (requires AES-NI)
+    SOURCE_REPLAY,      // cycle through a caller-provided array of words
+};
+
+struct bit_source_s {
+    enum source_kind kind;
+    void (*fill)(struct bit_source_s *source, u64 *buffer, u32 n);
+    union {
+        u64 xoshiro[4];
+        struct {
+            u32 key[8];
+            u64 counter;
+        } chacha;
+        struct {
+            u64 round_keys[22];
+            u64 counter;
+        } aes;
+        struct {
+            const u64 *words;
+            u64 length;
+            u64 pos;
+        } replay;
+    };
+};
+
+bool source_available(enum source_kind kind);
+
+// Generators seeded from the operating system.
+struct bit_source_s source_new(enum source_kind kind);
+
+// Generators with a deterministic 64-bit seed, for reproducible runs.
+// SOURCE_GETRANDOM ignores the seed.
+struct bit_source_s source_new_seeded(enum source_kind kind, u64 seed);
+
+// Deterministic source that repeats words[0], ..., words[length-1].
+// The array is not copied and must outlive the source.
+struct bit_source_s source_replay(const u64 *words, u64 length);
+
+#endif
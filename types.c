@@ -7,14 +7,32 @@
   Released under Apache 2.0; refer to LICENSE.txt
 */
 
-#include <stdlib.h>
 
+#include "arena.h"
 #include "types.h"
 
 void free_array(struct array_s x) {
-    free(x.a);
+    table_block_free(x.block);
 };
 
-u32 bytes_array(struct array_s *x) {
-    return x->length * sizeof(x->a[0]) + sizeof(x->length);
+u64 bytes_array(struct array_s *x) {
+    u64 bytes[] = { (u64)x->length * sizeof(x->a[0]) };
+    return sizeof(*x) + table_block_bytes(1, bytes);
 };
+
+void free_array64(struct array64_s x) {
+    table_block_free(x.block);
+};
+
+u64 bytes_array64(struct array64_s *x) {
+    u64 bytes[] = { (u64)x->length * sizeof(x->a[0]) };
+    return sizeof(*x) + table_block_bytes(1, bytes);
+};
+
+void index_pack(void *a, u32 width, const u32 *src, u64 n) {
+    SWITCH_INDEX_WIDTH(w, width,
+        for (u64 i = 0; i < n; ++i) {
+            index_set(a, w, i, src[i]);
+        }
+    )
+}
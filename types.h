@@ -16,6 +16,8 @@
 #define likely(x)       __builtin_expect(!!(x), 1)
 #define unlikely(x)     __builtin_expect(!!(x), 0)
 
+#define u8 uint8_t
+#define u16 uint16_t
 #define u32 uint32_t
 #define u64 uint64_t
 #define u128 __uint128_t
@@ -23,15 +25,84 @@
 #define f32 float
 #define f64 double
 
+// Index arrays (outcomes, aliases, odds, offsets) are stored in the
+// narrowest width, in bytes, that holds their largest entry, fixed when
+// the table is built. Samplers pass a constant width to index_get inside
+// SWITCH_INDEX_WIDTH or SWITCH_WEIGHT_WIDTH, which make one copy of the
+// loop per width, so that each load is a plain load of that width.
+static inline u32 index_width(u64 max_entry) {
+    return max_entry <= UINT8_MAX ? 1
+        : max_entry <= UINT16_MAX ? 2
+        : max_entry <= UINT32_MAX ? 4 : 8;
+}
+
+static inline u64 index_get(const void *a, u32 width, u64 i) {
+    switch (width) {
+    case 1: return ((const u8 *)a)[i];
+    case 2: return ((const u16 *)a)[i];
+    case 4: return ((const u32 *)a)[i];
+    default: return ((const u64 *)a)[i];
+    }
+}
+
+static inline void index_set(void *a, u32 width, u64 i, u64 v) {
+    switch (width) {
+    case 1: ((u8 *)a)[i] = v; break;
+    case 2: ((u16 *)a)[i] = v; break;
+    case 4: ((u32 *)a)[i] = v; break;
+    default: ((u64 *)a)[i] = v;
+    }
+}
+
+// Copy n u32 entries of src to a of the given width.
+void index_pack(void *a, u32 width, const u32 *src, u64 n);
+
+// Run the statements with the constant width set to w, for w = 1, 2 or 4.
+#define SWITCH_INDEX_WIDTH(width, w, ...) \
+    switch (w) { \
+    case 1: { const u32 width = 1; __VA_ARGS__ } break; \
+    case 2: { const u32 width = 2; __VA_ARGS__ } break; \
+    default: { const u32 width = 4; __VA_ARGS__ } break; \
+    }
+
+// The same for w = 4 or 8.
+#define SWITCH_WEIGHT_WIDTH(width, w, ...) \
+    switch (w) { \
+    case 4: { const u32 width = 4; __VA_ARGS__ } break; \
+    default: { const u32 width = 8; __VA_ARGS__ } break; \
+    }
+
+// Divisor n with its reciprocal, from uniform_modulus in uniform.h,
+// so that draws in [0, n) need no division instruction.
+struct uniform_modulus_s {
+    u64 n;
+    u64 inverse;
+};
+
 // array
 struct array_s
 {
     u32 length;
     u32 *a;
+    void *block;
+    struct uniform_modulus_s modulus;   // of a[length - 1], for sampling
 };
 
 void free_array(struct array_s x);
 
-u32 bytes_array(struct array_s *x);
+u64 bytes_array(struct array_s *x);
+
+// array with 64-bit entries
+struct array64_s
+{
+    u32 length;
+    u64 *a;
+    void *block;
+    struct uniform_modulus_s modulus;   // of a[length - 1], for sampling
+};
+
+void free_array64(struct array64_s x);
+
+u64 bytes_array64(struct array64_s *x);
 
 #endif
\ No newline at end of file
@@ -10,6 +10,11 @@
 #ifndef UNIFORM_H
 #define UNIFORM_H
 
+#ifdef RR_COUNTERS
+#include <math.h>
+#endif
+
+#include "source.h"
 #include "types.h"
 
 struct uniform_preprocessed_s {
@@ -19,10 +24,101 @@ struct uniform_preprocessed_s {
     u64 inverse;
 };
 
+// Width of the recycled state unif_state ~ unif[0, unif_bound).
+// By default it is a u64, refilled whenever the bound drops below 2^56.
+// With -DRR_STATE128 it is a u128, refilled whenever the bound drops
+// below 2^120: rejections in uniform_eo become negligible and ranges
+// up to 2^63 are allowed, at the cost of 128-bit division.
+#ifdef RR_STATE128
+#define rr_uint u128
+#define RR_STATE_BITS 128
+#define RR_MAX_RANGE_BITS 63
+#else
+#define rr_uint u64
+#define RR_STATE_BITS 64
+#define RR_MAX_RANGE_BITS 56
+#endif
+
+// After check_refill_uniform the bound is at least 2^RR_REFILL_BITS.
+#define RR_REFILL_BITS (RR_STATE_BITS - 8)
+
+// Largest n for which uniform_eo(n) is guaranteed to make progress.
+// The samplers with 64-bit weights require totals up to this range.
+#define RR_MAX_RANGE (1ull << RR_MAX_RANGE_BITS)
+
+// Entropy accounting, updated only when compiled with -DRR_COUNTERS.
+// The lost_* fields hold bits of information discarded by each lossy
+// split, measured as log2 of the bound before the split over the total
+// bound of the output and the recycled state after it.
+struct rr_counters_s {
+    u64 bits_refilled;      // bits pulled from the source by refill
+    u64 bits_flipped;       // bits drawn through flip_n
+    u64 uniform_refills;    // check_refill_uniform calls that added bits
+    u64 uniform_retries;    // r_bound splits, after which uniform_eo draws again
+    u64 prediv_rejections;  // remainders discarded by uniform_prediv
+    u64 aldr_rejections;    // rejected walks of sample_aldr_recycle
+    f64 lost_uniform;       // r_bound split in uniform_eo and its variants
+    f64 lost_prediv;        // remainder discard in uniform_prediv
+    f64 lost_aldr;          // accept-reject split in sample_aldr_recycle
+};
+
+#ifdef RR_COUNTERS
+#define rr_count(s, field, x) ((s)->counters.field += (x))
+#define rr_lost(s, field, before, after) \
+    ((s)->counters.field += log2((f64)(before)) - log2((f64)(after)))
+#else
+#define rr_count(s, field, x) ((void)0)
+#define rr_lost(s, field, before, after) ((void)0)
+#endif
+
+// Bits consumed from the source by the thread-local state
+// (always zero unless compiled with -DRR_COUNTERS).
+#define bits_consumed (rr_default.counters.bits_flipped)
+
+// Randomness recycling state: a buffer of random bits from a source,
+// and the recycled uniform unif_state ~ unif[0, unif_bound).
+// Each thread must use its own state; preprocessed tables are
+// read-only while sampling and may be shared between threads.
+struct rr_state {
+    rr_uint unif_state;
+    rr_uint unif_bound;
+    u64 flip_word;
+    u32 flip_pos;
+    u32 flip_buffer_pos;
+    struct bit_source_s source;
+    struct rr_counters_s counters;
+    u64 flip_buffer[SOURCE_BUFFER_WORDS];
+};
+
+// Empty state; the source defaults to getrandom on first use.
+#define RR_STATE_INIT {                         \
+    .unif_state = 0,                            \
+    .unif_bound = 1,                            \
+    .flip_word = 0,                             \
+    .flip_pos = 0,                              \
+    .flip_buffer_pos = SOURCE_BUFFER_WORDS,     \
+    .source = { .fill = NULL },                 \
+    .counters = { 0 }                           \
+}
+
+// Thread-local state used by the functions without an _r suffix.
+extern __thread struct rr_state rr_default;
+
+void rr_state_init(struct rr_state *s, struct bit_source_s source);
+void set_bit_source(struct bit_source_s source);
+
+u64 flip_n_r(struct rr_state *s, u32 n);
+void merge_state_r(struct rr_state *s, u64 state, u64 bound);
+void merge_state_bits_r(struct rr_state *s, u64 state, u64 n);
+u64 uniform_eo_r(struct rr_state *s, u64 n);
+u64 flip_n_from_unif_r(struct rr_state *s, u32 n);
+u32 uniform_u32_from_unif_r(struct rr_state *s);
+bool bernoulli_eo_r(struct rr_state *s, u32 numer, u32 denom);
+u32 uniform_prediv_r(struct rr_state *s, struct uniform_preprocessed_s *x);
+
 u32 flip(void);
 u64 flip_n(u32 n);
 
-extern u64 bits_consumed;
 void merge_state(u64 state, u64 bound);
 void merge_state_bits(u64 state, u64 n);
 u64 uniform_eo(u64 n);
@@ -32,6 +128,12 @@ bool bernoulli_eo(u32 numer, u32 denom);
 struct uniform_preprocessed_s uniform_preprocess(u32 m);
 u32 uniform_prediv(struct uniform_preprocessed_s *x);
 
+// uniform_eo(n) for a modulus prepared once by uniform_modulus(n): the
+// same output and recycled state, with the divisions of unif_state and
+// unif_bound by n replaced by multiplications by the reciprocal.
+struct uniform_modulus_s uniform_modulus(u64 n);
+u64 uniform_eo_mod_r(struct rr_state *s, const struct uniform_modulus_s *m);
+u64 uniform_eo_mod(const struct uniform_modulus_s *m);
 
 // Macros for min and max.
 #define max(a, b)           \
@@ -48,4 +150,272 @@ u32 uniform_prediv(struct uniform_preprocessed_s *x);
     _a < _b ? _a : _b;      \
   })
 
+// Inline primitives on a caller-held copy of unif_state and unif_bound.
+// The _r functions above apply these to the fields of a struct rr_state;
+// batch loops apply them to local variables so that the recycled state
+// stays in registers, and only the bit buffer in s is touched in memory.
+
+static inline u32 clz_state(rr_uint x) {
+    // Input x > 0.
+#ifdef RR_STATE128
+    u64 hi = x >> 64;
+    return hi ? __builtin_clzll(hi) : 64 + __builtin_clzll((u64)x);
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+static inline void check_refill_uniform_local(struct rr_state *s, rr_uint *state, rr_uint *bound) {
+    // Update state and bound so that
+    // bound >= 2^(RR_STATE_BITS - 1),
+    // while retaining
+    // state ~ unif[0, bound).
+    // Topping up only below 2^RR_REFILL_BITS loses no information by itself;
+    // a smaller bound shows up as more rejections in lost_uniform.
+    u32 num_bits_extract = clz_state(*bound);
+    if (num_bits_extract >= 8) {
+        rr_count(s, uniform_refills, 1);
+#ifdef RR_STATE128
+        if (num_bits_extract > 64) {
+            *bound <<= 64;
+            *state = (*state << 64) | flip_n_r(s, 64);
+            num_bits_extract -= 64;
+        }
+#endif
+        *bound <<= num_bits_extract;
+        *state <<= num_bits_extract;
+        *state |= flip_n_r(s, num_bits_extract);
+    }
+}
+
+static inline void merge_state_local(rr_uint *state, rr_uint *bound, u64 x, u64 x_bound) {
+    // Input x and x_bound must be
+    // independent of state and bound and satisfy
+    // x ~ unif[0, x_bound).
+    // Merge them into state and bound,
+    // retaining state ~ unif[0, bound).
+    *bound *= x_bound;
+    *state = *state * x_bound + x;
+}
+
+static inline u64 uniform_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound, u64 n) {
+    // Input positive integer n should be (much) smaller than
+    // 2^RR_REFILL_BITS, and at most RR_MAX_RANGE for efficiency.
+    // Output is distributed as unif[0, n),
+    // while state is independent of the output and retains
+    // state ~ unif[0, bound).
+    for (;;) {
+        check_refill_uniform_local(s, state, bound);
+        rr_uint q_state = *state / n;
+        u64 r_state = *state % n;
+        rr_uint q_bound = *bound / n;
+        rr_uint r_bound = *bound % n;
+        // Discard information of bernoulli(r_bound, bound)
+        // to split into two branches.
+        if (likely(q_state < q_bound)) {
+            // q_state ~ unif[0, q_bound)
+            // r_state ~ unif[0, n)
+            // q_state and r_state are independent
+            rr_lost(s, lost_uniform, *bound, q_bound * n);
+            *state = q_state;
+            *bound = q_bound;
+            return r_state;
+        }
+        // q_state = q_bound
+        // r_state ~ unif[0, r_bound)
+        rr_lost(s, lost_uniform, *bound, r_bound);
+        rr_count(s, uniform_retries, 1);
+        *state = r_state;
+        *bound = r_bound;
+        if (unlikely(r_bound >> RR_REFILL_BITS)) {
+            // Only for n > 2^RR_REFILL_BITS. Then r_bound < n can still be
+            // at least 2^RR_REFILL_BITS, so check_refill_uniform_local
+            // adds no bits and the next pass rejects again with the same
+            // state and bound, looping forever. Discard the remainder
+            // and start over from an empty state, which the refill fills.
+            rr_lost(s, lost_uniform, r_bound, 1);
+            *state = 0;
+            *bound = 1;
+        }
+    }
+}
+
+static inline u64 divide_modulus(u64 x, const struct uniform_modulus_s *m, u64 *r) {
+    // Return x / m->n and set *r = x % m->n. With inverse = (2^64-1) / n,
+    // the estimate x * inverse / 2^64 is x / n or x / n - 1.
+    u64 q = ((u128)x * m->inverse) >> 64;
+    u64 rem = x - q * m->n;
+    bool over = rem >= m->n;
+    *r = rem - (over ? m->n : 0);
+    return q + over;
+}
+
+static inline u64 uniform_eo_mod_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct uniform_modulus_s *m) {
+#ifdef RR_STATE128
+    // A u128 state needs a 128-bit reciprocal; divide instead.
+    return uniform_eo_local(s, state, bound, m->n);
+#else
+    // As uniform_eo_local.
+    for (;;) {
+        check_refill_uniform_local(s, state, bound);
+        u64 r_state, r_bound;
+        u64 q_state = divide_modulus(*state, m, &r_state);
+        u64 q_bound = divide_modulus(*bound, m, &r_bound);
+        if (likely(q_state < q_bound)) {
+            rr_lost(s, lost_uniform, *bound, q_bound * m->n);
+            *state = q_state;
+            *bound = q_bound;
+            return r_state;
+        }
+        rr_lost(s, lost_uniform, *bound, r_bound);
+        rr_count(s, uniform_retries, 1);
+        *state = r_state;
+        *bound = r_bound;
+        if (unlikely(r_bound >> RR_REFILL_BITS)) {
+            // As in uniform_eo_local: a remainder too large to refill.
+            rr_lost(s, lost_uniform, r_bound, 1);
+            *state = 0;
+            *bound = 1;
+        }
+    }
+#endif
+}
+
+static inline u64 flip_n_from_unif_local(struct rr_state *s, rr_uint *state, rr_uint *bound, u32 n) {
+    // Specialize uniform_eo to use bit shifts, not division,
+    // for n uniform bits.
+    // Use this instead of the random bit source directly
+    // if you plan to recycle randomness, to avoid overflow.
+    for (;;) {
+        check_refill_uniform_local(s, state, bound);
+        rr_uint q_state = *state >> n;
+        u64 r_state = *state & (((rr_uint)1 << n) - 1);
+        rr_uint q_bound = *bound >> n;
+        rr_uint r_bound = *bound & (((rr_uint)1 << n) - 1);
+        if (likely(q_state < q_bound)) {
+            rr_lost(s, lost_uniform, *bound, q_bound << n);
+            *state = q_state;
+            *bound = q_bound;
+            return r_state;
+        }
+        rr_lost(s, lost_uniform, *bound, r_bound);
+        rr_count(s, uniform_retries, 1);
+        *state = r_state;
+        *bound = r_bound;
+        if (unlikely(r_bound >> RR_REFILL_BITS)) {
+            // Only for n > RR_REFILL_BITS, as in uniform_eo_local:
+            // without this, flip_n_from_unif(n) for n > RR_REFILL_BITS
+            // (ALDR with a weight sum past 2^28) never returns.
+            rr_lost(s, lost_uniform, r_bound, 1);
+            *state = 0;
+            *bound = 1;
+        }
+    }
+}
+
+static inline u32 uniform_u32_from_unif_local(struct rr_state *s, rr_uint *state, rr_uint *bound) {
+    // Specialize uniform_eo to use bit shifts, not division,
+    // for the case of n = 1<<32.
+    for (;;) {
+        check_refill_uniform_local(s, state, bound);
+        rr_uint q_state = *state >> 32;
+        u32 r_state = *state;
+        rr_uint q_bound = *bound >> 32;
+        u32 r_bound = *bound;
+        if (likely(q_state < q_bound)) {
+            rr_lost(s, lost_uniform, *bound, q_bound << 32);
+            *state = q_state;
+            *bound = q_bound;
+            return r_state;
+        }
+        rr_lost(s, lost_uniform, *bound, r_bound);
+        rr_count(s, uniform_retries, 1);
+        *state = r_state;
+        *bound = r_bound;
+    }
+}
+
+static inline u32 uniform_prediv_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        const struct uniform_preprocessed_s *x) {
+    // Compute and recycle uniform, with precomputed divisions.
+    for (;;) {
+        u32 u = uniform_u32_from_unif_local(s, state, bound);
+        u64 unifm_rem = ((u64) u) * x->num_outcomes;
+        u32 unifm = unifm_rem >> 32;
+        u32 rem = unifm_rem;
+        if (likely(rem <= x->not_remainder)) {
+            // Compute ceiling of (1<<32) * (unifm / m), so
+            // u-lower_bound ~ unif[0, x->quotient)
+            // unifm ~ unif[0, m)
+            // u-lower_bound and unifm are independent
+            u32 lower_bound = (x->inverse * unifm) >> 32;
+            rr_lost(s, lost_prediv, 1ull << 32, (u64)x->num_outcomes * x->quotient);
+            merge_state_local(state, bound, u - lower_bound, x->quotient);
+            return unifm;
+        }
+        // Don't bother trying to recycle the remainder
+        rr_count(s, lost_prediv, 32);
+        rr_count(s, prediv_rejections, 1);
+    }
+}
+
+static inline bool bernoulli_eo_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        u64 numer, u64 denom) {
+    // Input 0 <= numer <= denom <= RR_MAX_RANGE.
+    for (;;) {
+        check_refill_uniform_local(s, state, bound);
+        rr_uint q_bound = *bound / denom;
+        u64 r_bound = *bound % denom;
+        rr_uint true_bound = q_bound * numer;
+        rr_uint full_bound = q_bound * denom;
+        if (*state < true_bound) {
+            rr_lost(s, lost_uniform, *bound, full_bound);
+            *bound = true_bound;
+            return 1;
+        }
+        if (likely(*state < full_bound)) {
+            rr_lost(s, lost_uniform, *bound, full_bound);
+            *state -= true_bound;
+            *bound = full_bound - true_bound;
+            return 0;
+        }
+        rr_lost(s, lost_uniform, *bound, r_bound);
+        rr_count(s, uniform_retries, 1);
+        *state -= full_bound;
+        *bound = r_bound;
+    }
+}
+
+static inline bool bernoulli_eo_mod_local(struct rr_state *s, rr_uint *state, rr_uint *bound,
+        u64 numer, const struct uniform_modulus_s *denom) {
+#ifdef RR_STATE128
+    return bernoulli_eo_local(s, state, bound, numer, denom->n);
+#else
+    // As bernoulli_eo_local, for denom prepared by uniform_modulus.
+    for (;;) {
+        check_refill_uniform_local(s, state, bound);
+        u64 r_bound;
+        u64 q_bound = divide_modulus(*bound, denom, &r_bound);
+        u64 true_bound = q_bound * numer;
+        u64 full_bound = q_bound * denom->n;
+        if (*state < true_bound) {
+            rr_lost(s, lost_uniform, *bound, full_bound);
+            *bound = true_bound;
+            return 1;
+        }
+        if (likely(*state < full_bound)) {
+            rr_lost(s, lost_uniform, *bound, full_bound);
+            *state -= true_bound;
+            *bound = full_bound - true_bound;
+            return 0;
+        }
+        rr_lost(s, lost_uniform, *bound, r_bound);
+        rr_count(s, uniform_retries, 1);
+        *state -= full_bound;
+        *bound = r_bound;
+    }
+#endif
+}
+
 #endif